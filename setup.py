@@ -149,7 +149,9 @@ setup(
     author_email='info@bcanalog.com',
     description='Python wrappers of cbag library using pybind11',
     license='Apache-2.0',
-    install_requires=[],
+    install_requires=[
+        'numpy',
+    ],
     setup_requires=[],
     tests_require=[
         'pytest',
@@ -71,6 +71,17 @@ std::string to_string(const c_box_arr &self) {
                        self.num[0], self.num[1], self.sp[0], self.sp[1]);
 }
 
+void write_box_arr_row(const c_box_arr &self, coord_t *row) {
+    row[0] = xl(self.base);
+    row[1] = yl(self.base);
+    row[2] = xh(self.base);
+    row[3] = yh(self.base);
+    row[4] = static_cast<coord_t>(self.num[0]);
+    row[5] = static_cast<coord_t>(self.num[1]);
+    row[6] = static_cast<coord_t>(self.sp[0]);
+    row[7] = static_cast<coord_t>(self.sp[1]);
+}
+
 coord_t get_coord(const c_box_arr &self, cbag::orientation_2d_t orient_code, bool bnd_code) {
     auto cur_coord =
         cbag::polygon::get_coord(self.base, static_cast<cbag::orientation_2d>(orient_code),
@@ -277,6 +288,8 @@ void bind_bbox_array(py::class_<c_box_arr> &py_cls) {
                py::arg("cp") = py::none());
     py_cls.def("get_copy", [](c_box_arr self) { return self; },
                "Returns a copy of this BBoxArray.");
+    py_cls.def("as_numpy", [](const c_box_arr &self) { return pu::box_arr_to_numpy(&self, 1); },
+               "Returns a (1, 8) array of [xl, yl, xh, yh, nx, ny, spx, spy].");
     py_cls.def("get_sub_array",
                [](const c_box_arr &self, cbag::orientation_2d_t orient_code, cbag::scnt_t div,
                   cbag::scnt_t idx) {
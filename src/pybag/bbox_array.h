@@ -47,10 +47,16 @@ limitations under the License.
 #ifndef PYBAG_BBOX_ARRAY_H
 #define PYBAG_BBOX_ARRAY_H
 
+#include <array>
+#include <cstddef>
+
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 
 #include <cbag/common/box_array.h>
 
+#include <pybag/typedefs.h>
+
 namespace py = pybind11;
 
 using c_box_arr = cbag::box_array;
@@ -58,6 +64,19 @@ using c_box_arr = cbag::box_array;
 namespace pybag {
 namespace util {
 std::string to_string(const c_box_arr &self);
+
+// writes the given box array as a row of [xl, yl, xh, yh, nx, ny, spx, spy].
+void write_box_arr_row(const c_box_arr &self, coord_t *row);
+
+// copies the n box arrays starting at begin into a new (n, 8) NumPy array.
+template <class Iter> py::array_t<coord_t> box_arr_to_numpy(Iter begin, std::size_t n) {
+    auto ans = py::array_t<coord_t>(std::array<py::ssize_t, 2>{static_cast<py::ssize_t>(n), 8});
+    auto *row = ans.mutable_data();
+    for (std::size_t idx = 0; idx < n; ++idx, ++begin, row += 8) {
+        write_box_arr_row(*begin, row);
+    }
+    return ans;
+}
 }
 } // namespace pybag
 
@@ -0,0 +1,270 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+Copyright 2020 Blue Cheetah Analog Design Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <fmt/core.h>
+
+#include <pybind11/numpy.h>
+
+#include <cbag/common/transformation_util.h>
+
+#include <pybag/bbox.h>
+#include <pybag/bbox_batch.h>
+#include <pybag/bbox_collection.h>
+#include <pybag/numpy_util.h>
+
+namespace pybag {
+namespace util {
+
+box_batch::box_batch(const coord_t *data, std::size_t n) : xl_(n), yl_(n), xh_(n), yh_(n) {
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        auto *ptr = data + 4 * idx;
+        xl_[idx] = ptr[0];
+        yl_[idx] = ptr[1];
+        xh_[idx] = ptr[2];
+        yh_[idx] = ptr[3];
+    }
+}
+
+box_batch::box_batch(const std::vector<cbag::box_t> &boxes)
+    : xl_(boxes.size()), yl_(boxes.size()), xh_(boxes.size()), yh_(boxes.size()) {
+    for (std::size_t idx = 0; idx < boxes.size(); ++idx) {
+        const auto &box = boxes[idx];
+        xl_[idx] = xl(box);
+        yl_[idx] = yl(box);
+        xh_[idx] = xh(box);
+        yh_[idx] = yh(box);
+    }
+}
+
+cbag::box_t box_batch::get_box(std::size_t idx) const {
+    if (idx >= size())
+        throw std::out_of_range(fmt::format("BBoxBatch index {} out of range.", idx));
+    return {xl_[idx], yl_[idx], xh_[idx], yh_[idx]};
+}
+
+void box_batch::write_rows(coord_t *data) const {
+    auto n = size();
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        auto *ptr = data + 4 * idx;
+        ptr[0] = xl_[idx];
+        ptr[1] = yl_[idx];
+        ptr[2] = xh_[idx];
+        ptr[3] = yh_[idx];
+    }
+}
+
+cbag::box_t box_batch::get_bound() const {
+    constexpr auto cmax = std::numeric_limits<coord_t>::max();
+    constexpr auto cmin = std::numeric_limits<coord_t>::min();
+    auto n = size();
+    auto *x0 = xl_.data();
+    auto *y0 = yl_.data();
+    auto *x1 = xh_.data();
+    auto *y1 = yh_.data();
+    auto bxl = cmax;
+    auto byl = cmax;
+    auto bxh = cmin;
+    auto byh = cmin;
+    // select instead of branch, so the reduction vectorizes.
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        bool valid = (x0[idx] <= x1[idx]) & (y0[idx] <= y1[idx]);
+        bxl = std::min(bxl, valid ? x0[idx] : cmax);
+        byl = std::min(byl, valid ? y0[idx] : cmax);
+        bxh = std::max(bxh, valid ? x1[idx] : cmin);
+        byh = std::max(byh, valid ? y1[idx] : cmin);
+    }
+    if (bxl > bxh)
+        return cbag::box_t::get_invalid_bbox();
+    return {bxl, byl, bxh, byh};
+}
+
+void box_batch::overlaps(const cbag::box_t &box, bool *out) const {
+    auto n = size();
+    auto *x0 = xl_.data();
+    auto *y0 = yl_.data();
+    auto *x1 = xh_.data();
+    auto *y1 = yh_.data();
+    auto bxl = xl(box);
+    auto byl = yl(box);
+    auto bxh = xh(box);
+    auto byh = yh(box);
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        out[idx] = (std::max(x0[idx], bxl) < std::min(x1[idx], bxh)) &
+                   (std::max(y0[idx], byl) < std::min(y1[idx], byh));
+    }
+}
+
+box_batch &box_batch::move_by(coord_t dx, coord_t dy) {
+    auto n = size();
+    auto *x0 = xl_.data();
+    auto *y0 = yl_.data();
+    auto *x1 = xh_.data();
+    auto *y1 = yh_.data();
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        x0[idx] += dx;
+        x1[idx] += dx;
+        y0[idx] += dy;
+        y1[idx] += dy;
+    }
+    return *this;
+}
+
+box_batch &box_batch::expand(coord_t dx, coord_t dy) {
+    auto n = size();
+    auto *x0 = xl_.data();
+    auto *y0 = yl_.data();
+    auto *x1 = xh_.data();
+    auto *y1 = yh_.data();
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        x0[idx] -= dx;
+        x1[idx] += dx;
+        y0[idx] -= dy;
+        y1[idx] += dy;
+    }
+    return *this;
+}
+
+// maps each [lo, hi] interval to sign * [lo, hi] shifted by off, where sign is 1 or -1.
+void map_interval(std::vector<coord_t> &lo, std::vector<coord_t> &hi, coord_t sign, coord_t off) {
+    auto n = lo.size();
+    auto *p0 = lo.data();
+    auto *p1 = hi.data();
+    if (sign > 0) {
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            p0[idx] += off;
+            p1[idx] += off;
+        }
+    } else {
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            auto new_lo = off - p1[idx];
+            p1[idx] = off - p0[idx];
+            p0[idx] = new_lo;
+        }
+    }
+}
+
+box_batch &box_batch::transform(const cbag::transformation &xform) {
+    // every orientation maps each axis to plus or minus one axis, followed by a shift.  Find the
+    // source axis and sign of each new axis once, then map lower and upper bounds to the bounds
+    // they become under that orientation, so invalid boxes stay invalid.
+    auto p0 = xform.transform(0, 0);
+    auto px = xform.transform(1, 0);
+    auto py = xform.transform(0, 1);
+    coord_t dx = p0[0];
+    coord_t dy = p0[1];
+    auto swap_xy = (px[0] == dx);
+    coord_t sx = swap_xy ? py[0] - dx : px[0] - dx;
+    coord_t sy = swap_xy ? px[1] - dy : py[1] - dy;
+    if (swap_xy) {
+        std::swap(xl_, yl_);
+        std::swap(xh_, yh_);
+    }
+    map_interval(xl_, xh_, sx, dx);
+    map_interval(yl_, yh_, sy, dy);
+    return *this;
+}
+
+box_batch &box_batch::intersect(const cbag::box_t &box) {
+    auto n = size();
+    auto *x0 = xl_.data();
+    auto *y0 = yl_.data();
+    auto *x1 = xh_.data();
+    auto *y1 = yh_.data();
+    auto bxl = xl(box);
+    auto byl = yl(box);
+    auto bxh = xh(box);
+    auto byh = yh(box);
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        x0[idx] = std::max(x0[idx], bxl);
+        y0[idx] = std::max(y0[idx], byl);
+        x1[idx] = std::min(x1[idx], bxh);
+        y1[idx] = std::min(y1[idx], byh);
+    }
+    return *this;
+}
+
+// returns a writable NumPy view of the given column that keeps the batch alive.
+template <coord_t *(box_batch::*Column)()> py::array_t<coord_t> column_view(py::object obj) {
+    auto &self = obj.cast<box_batch &>();
+    return py::array_t<coord_t>(self.size(), (self.*Column)(), obj);
+}
+
+} // namespace util
+} // namespace pybag
+
+namespace pu = pybag::util;
+
+void bind_bbox_batch(py::class_<c_box_batch> &py_cls) {
+    py_cls.doc() = "A batch of BBox stored as contiguous coordinate arrays.";
+    py_cls.def(py::init<>(), "Create an empty BBoxBatch.");
+    py_cls.def(py::init([](const pu::py_coord_array &boxes) {
+                   return c_box_batch(boxes.data(), pu::num_boxes(boxes));
+               }),
+               "Create a BBoxBatch from a (N, 4) array of [xl, yl, xh, yh] rows.",
+               py::arg("boxes"));
+    py_cls.def(py::init([](const c_box_col &boxes) { return c_box_batch(pu::get_boxes(boxes)); }),
+               "Create a BBoxBatch from all boxes in the given BBoxCollection.", py::arg("boxes"));
+
+    py_cls.def("__len__", &c_box_batch::size, "Returns the number of boxes.");
+    py_cls.def("__getitem__", &c_box_batch::get_box, "Returns the box at the given index.",
+               py::arg("idx"));
+    py_cls.def_property_readonly("xl", &pu::column_view<&c_box_batch::xl_data>,
+                                 "Left coordinates, as a writable view.");
+    py_cls.def_property_readonly("yl", &pu::column_view<&c_box_batch::yl_data>,
+                                 "Bottom coordinates, as a writable view.");
+    py_cls.def_property_readonly("xh", &pu::column_view<&c_box_batch::xh_data>,
+                                 "Right coordinates, as a writable view.");
+    py_cls.def_property_readonly("yh", &pu::column_view<&c_box_batch::yh_data>,
+                                 "Top coordinates, as a writable view.");
+    py_cls.def_property_readonly("bound_box", &c_box_batch::get_bound,
+                                 "The union bounding box of all valid boxes.");
+
+    py_cls.def("to_array",
+               [](const c_box_batch &self) {
+                   auto ans = py::array_t<coord_t>(
+                       {static_cast<py::ssize_t>(self.size()), static_cast<py::ssize_t>(4)});
+                   self.write_rows(ans.mutable_data());
+                   return ans;
+               },
+               "Returns a copy of all boxes as a (N, 4) array of [xl, yl, xh, yh] rows.");
+    py_cls.def("get_copy", [](const c_box_batch &self) { return c_box_batch(self); },
+               "Returns a copy of this BBoxBatch.");
+    py_cls.def("overlaps",
+               [](const c_box_batch &self, const c_box &bbox) {
+                   auto ans = py::array_t<bool>(self.size());
+                   self.overlaps(bbox, ans.mutable_data());
+                   return ans;
+               },
+               "Returns a boolean array that is True where a box overlaps the given BBox.",
+               py::arg("bbox"));
+    // the in-place methods return this object itself, not a copy, so calls can be chained.
+    py_cls.def("move_by", &c_box_batch::move_by, py::return_value_policy::reference_internal,
+               "Moves all boxes in place.  Returns this BBoxBatch.", py::arg("dx") = 0,
+               py::arg("dy") = 0);
+    py_cls.def("expand", &c_box_batch::expand, py::return_value_policy::reference_internal,
+               "Expands all boxes (on all sides) in place.  Returns this BBoxBatch.",
+               py::arg("dx") = 0, py::arg("dy") = 0);
+    py_cls.def("transform", &c_box_batch::transform, py::return_value_policy::reference_internal,
+               "Transforms all boxes in place.  Returns this BBoxBatch.", py::arg("xform"));
+    py_cls.def("intersect", &c_box_batch::intersect, py::return_value_policy::reference_internal,
+               "Sets each box to its intersection with the given BBox.  Returns this BBoxBatch.",
+               py::arg("bbox"));
+}
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+Copyright 2020 Blue Cheetah Analog Design Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef PYBAG_BBOX_BATCH_H
+#define PYBAG_BBOX_BATCH_H
+
+#include <cstddef>
+#include <vector>
+
+#include <pybind11/pybind11.h>
+
+#include <cbag/common/box_t.h>
+#include <cbag/common/transformation.h>
+
+#include <pybag/typedefs.h>
+
+namespace py = pybind11;
+
+namespace pybag {
+namespace util {
+
+/** A batch of bounding boxes stored as a structure of arrays.
+ *
+ *  Each coordinate is stored in its own contiguous array, so bulk operations are simple loops
+ *  that the compiler can vectorize.  The number of boxes is fixed at construction, so pointers
+ *  returned by the column accessors stay valid for the lifetime of this object.
+ */
+class box_batch {
+  private:
+    std::vector<coord_t> xl_;
+    std::vector<coord_t> yl_;
+    std::vector<coord_t> xh_;
+    std::vector<coord_t> yh_;
+
+  public:
+    box_batch() = default;
+
+    // constructs from a C-contiguous (N, 4) array of [xl, yl, xh, yh] rows.
+    box_batch(const coord_t *data, std::size_t n);
+
+    explicit box_batch(const std::vector<cbag::box_t> &boxes);
+
+    std::size_t size() const noexcept { return xl_.size(); }
+
+    coord_t *xl_data() noexcept { return xl_.data(); }
+    coord_t *yl_data() noexcept { return yl_.data(); }
+    coord_t *xh_data() noexcept { return xh_.data(); }
+    coord_t *yh_data() noexcept { return yh_.data(); }
+
+    cbag::box_t get_box(std::size_t idx) const;
+
+    // writes all boxes to a C-contiguous (N, 4) array of [xl, yl, xh, yh] rows.
+    void write_rows(coord_t *data) const;
+
+    // returns the bounding box of all valid boxes, or an invalid box if there are none.
+    cbag::box_t get_bound() const;
+
+    // writes whether each box overlaps the given box (touching does not count).
+    void overlaps(const cbag::box_t &box, bool *out) const;
+
+    // the following modify this object in place and return *this.
+    box_batch &move_by(coord_t dx, coord_t dy);
+    box_batch &expand(coord_t dx, coord_t dy);
+    box_batch &transform(const cbag::transformation &xform);
+    box_batch &intersect(const cbag::box_t &box);
+};
+
+} // namespace util
+} // namespace pybag
+
+using c_box_batch = pybag::util::box_batch;
+
+void bind_bbox_batch(py::class_<c_box_batch> &);
+
+#endif
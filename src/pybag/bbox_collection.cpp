@@ -46,6 +46,8 @@ limitations under the License.
 
 #include <fmt/core.h>
 
+#include <cbag/common/transformation_util.h>
+
 #include <pybind11_generics/iterator.h>
 
 #include <pybag/bbox_array.h>
@@ -56,6 +58,24 @@ namespace pyg = pybind11_generics;
 namespace pybag {
 namespace util {
 
+std::vector<cbag::box_t> get_boxes(const c_box_col &self) {
+    auto ans = std::vector<cbag::box_t>();
+    for (const auto &barr : self) {
+        for (cbag::cnt_t iy = 0; iy < barr.num[1]; ++iy) {
+            for (cbag::cnt_t ix = 0; ix < barr.num[0]; ++ix) {
+                ans.push_back(cbag::polygon::get_move_by(
+                    barr.base, static_cast<cbag::offset_t>(ix) * barr.sp[0],
+                    static_cast<cbag::offset_t>(iy) * barr.sp[1]));
+            }
+        }
+    }
+    return ans;
+}
+
+py::array_t<coord_t> as_numpy(const c_box_col &self) {
+    return box_arr_to_numpy(self.begin(), self.size());
+}
+
 pyg::PyIterator<c_box_arr> get_box_arr_iter(const c_box_col &bcol) {
     return pyg::make_iterator(bcol.begin(), bcol.end());
 }
@@ -97,6 +117,9 @@ void bind_bbox_collection(py::class_<c_box_col> &py_cls) {
     py_cls.def("__iter__", &pu::get_box_arr_iter,
                "Returns an iterator over BBoxArray in this collection.");
     py_cls.def("__len__", &c_box_col::size, "Returns the number of BBoxArrays in this collection.");
+    py_cls.def("as_numpy", &pu::as_numpy,
+               "Returns a (N, 8) array with one [xl, yl, xh, yh, nx, ny, spx, spy] row per "
+               "BBoxArray.  The array is a copy, so it stays valid when this collection changes.");
     py_cls.def("add_rect_arr", &c_box_col::append, "Add bbox to this collection.", py::arg("box"),
                py::arg("nx") = 1, py::arg("ny") = 1, py::arg("spx") = 0, py::arg("spy") = 0);
 }
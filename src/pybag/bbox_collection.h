@@ -47,6 +47,8 @@ limitations under the License.
 #ifndef PYBAG_BBOX_COLLECTION_H
 #define PYBAG_BBOX_COLLECTION_H
 
+#include <vector>
+
 #include <pybind11/pybind11.h>
 
 #include <cbag/common/box_collection.h>
@@ -55,6 +57,12 @@ namespace py = pybind11;
 
 using c_box_col = cbag::box_collection;
 
+namespace pybag {
+namespace util {
+std::vector<cbag::box_t> get_boxes(const c_box_col &self);
+}
+} // namespace pybag
+
 void bind_bbox_collection(py::class_<c_box_col> &);
 
 #endif
@@ -18,6 +18,8 @@
 #
 # NOTE: This dynamically typed stub was automatically generated by stubgen.
 
+import numpy
+
 from builtins import int
 from builtins import str
 from pybag.enum import LogLevel
@@ -32,6 +34,7 @@ from typing import Any
 from typing import List
 from typing import Iterable
 from typing import Union
+from typing import Dict
 
 COORD_MAX: int = ...
 COORD_MIN: int = ...
@@ -158,6 +161,7 @@ class BBoxArray:
     def __init__(self, base: BBox, orient_code: int, nt: int = 1, spt: int = 0, np: int = 1, spp: int = 0) -> None: ...
     def __eq__(self, other: BBoxArray) -> bool: ...
     def __iter__(self) -> Iterator[BBox]: ...
+    def as_numpy(self) -> numpy.ndarray: ...
     def extend_orient(self, orient_code: int, ct: Optional[int] = None, cp: Optional[int] = None) -> BBoxArray: ...
     def get_array_info(self, orient_code: int) -> Tuple[int, int]: ...
     def get_bbox(self, idx: int) -> BBox: ...
@@ -174,11 +178,40 @@ class BBoxArray:
     def transform(self, xform: Transform) -> BBoxArray: ...
 
 
+class BBoxBatch:
+    @property
+    def bound_box(self) -> BBox: ...
+    @property
+    def xh(self) -> numpy.ndarray: ...
+    @property
+    def xl(self) -> numpy.ndarray: ...
+    @property
+    def yh(self) -> numpy.ndarray: ...
+    @property
+    def yl(self) -> numpy.ndarray: ...
+    @overload
+    def __init__(self) -> None: ...
+    @overload
+    def __init__(self, boxes: numpy.ndarray) -> None: ...
+    @overload
+    def __init__(self, boxes: BBoxCollection) -> None: ...
+    def __getitem__(self, idx: int) -> BBox: ...
+    def __len__(self) -> int: ...
+    def expand(self, dx: int = 0, dy: int = 0) -> BBoxBatch: ...
+    def get_copy(self) -> BBoxBatch: ...
+    def intersect(self, bbox: BBox) -> BBoxBatch: ...
+    def move_by(self, dx: int = 0, dy: int = 0) -> BBoxBatch: ...
+    def overlaps(self, bbox: BBox) -> numpy.ndarray: ...
+    def to_array(self) -> numpy.ndarray: ...
+    def transform(self, xform: Transform) -> BBoxBatch: ...
+
+
 class BBoxCollection:
     def __init__(self) -> None: ...
     def __iter__(self) -> Iterator[BBoxArray]: ...
     def __len__(self) -> int: ...
     def add_rect_arr(self, box: BBox, nx: int = 1, ny: int = 1, spx: int = 0, spy: int = 0) -> None: ...
+    def as_numpy(self) -> numpy.ndarray: ...
 
 
 class FileLogger:
@@ -201,6 +234,20 @@ class FileLogger:
     def warn(self, msg: str) -> None: ...
 
 
+class MappedRTree:
+    @property
+    def bound_box(self) -> BBox: ...
+    def __init__(self, fname: str) -> None: ...
+    def __bool__(self) -> bool: ...
+    def __len__(self) -> int: ...
+    def get_bbox(self, obj_id: int) -> BBox: ...
+    def get_values(self, ids: numpy.ndarray) -> numpy.ndarray: ...
+    def intersect_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def intersect_ids(self, box: BBox) -> numpy.ndarray: ...
+    def overlap_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def overlap_ids(self, box: BBox) -> numpy.ndarray: ...
+
+
 class PyBlockage:
     def __init__(self) -> None: ...
     def commit(self) -> None: ...
@@ -249,37 +296,97 @@ class PyLayCellView:
     @property
     def cell_name(self) -> str: ...
     @property
+    def content_hash(self) -> int: ...
+    @property
     def is_empty(self) -> bool: ...
     def __init__(self, grid: PyRoutingGrid, tr_colors: TrackColoring, cell_name: str) -> None: ...
     def __eq__(self, other: PyLayCellView) -> bool: ...
+    @overload
     def add_blockage(self, layer: str, blk_code: int, points: List[Tuple[int, int]], commit: bool) -> PyBlockage: ...
+    @overload
+    def add_blockage(self, layer: str, blk_code: int, points: numpy.ndarray, commit: bool) -> PyBlockage: ...
+    @overload
     def add_boundary(self, bnd_code: int, points: List[Tuple[int, int]], commit: bool) -> PyBoundary: ...
+    @overload
+    def add_boundary(self, bnd_code: int, points: numpy.ndarray, commit: bool) -> PyBoundary: ...
     def add_instance(self, cv: PyLayCellView, name: str, xform: Transform, nx: int, ny: int, spx: int, spy: int, commit: bool) -> PyLayInstRef: ...
+    def add_instances(self, cv: PyLayCellView, names: List[str], xforms: numpy.ndarray, nx: int = 1, ny: int = 1, spx: int = 0, spy: int = 0, commit: bool = True, return_refs: bool = False) -> Optional[List[PyLayInstRef]]: ...
     def add_label(self, layer: str, purpose: str, xform: Transform, label: str, height: int) -> None: ...
+    @overload
     def add_path(self, layer: str, purpose: str, points: List[Tuple[int, int]], half_width: int, style0: int, style1: int, stylem: int, commit: bool) -> PyPath: ...
+    @overload
+    def add_path(self, layer: str, purpose: str, points: numpy.ndarray, half_width: int, style0: int, style1: int, stylem: int, commit: bool) -> PyPath: ...
+    @overload
     def add_path45_bus(self, layer: str, purpose: str, points: List[Tuple[int, int]], widths: List[int], spaces: List[int], style0: int, style1: int, stylem: int, commit: bool) -> PyPath: ...
+    @overload
+    def add_path45_bus(self, layer: str, purpose: str, points: numpy.ndarray, widths: List[int], spaces: List[int], style0: int, style1: int, stylem: int, commit: bool) -> PyPath: ...
     def add_pin(self, layer: str, net: str, label: str, bbox: BBox) -> None: ...
     def add_pin_arr(self, net: str, label: str, tid: PyTrackID, lower: int, upper: int) -> None: ...
+    @overload
     def add_poly(self, layer: str, purpose: str, points: List[Tuple[int, int]], commit: bool) -> PyPolygon: ...
+    @overload
+    def add_poly(self, layer: str, purpose: str, points: numpy.ndarray, commit: bool) -> PyPolygon: ...
     def add_prim_instance(self, lib: str, cell: str, view: str, name: str, xform: Transform, nx: int, ny: int, spx: int, spy: int, commit: bool) -> PyLayInstRef: ...
+    @overload
     def add_rect(self, layer: str, purpose: str, bbox: BBox, commit: bool) -> PyRect: ...
     @overload
+    def add_rect(self, layer_key: int, bbox: BBox, commit: bool) -> PyRect: ...
+    @overload
     def add_rect_arr(self, layer: str, purpose: str, box: BBox, nx: int, ny: int, spx: int, spy: int) -> None: ...
     @overload
+    def add_rect_arr(self, layer_key: int, box: BBox, nx: int, ny: int, spx: int, spy: int) -> None: ...
+    @overload
     def add_rect_arr(self, layer: str, purpose: str, barr: BBoxArray) -> None: ...
+    @overload
+    def add_rect_arr(self, layer_key: int, barr: BBoxArray) -> None: ...
+    @overload
     def add_rect_list(self, layer: str, purpose: str, bcol: BBoxCollection) -> None: ...
+    @overload
+    def add_rect_list(self, layer_key: int, bcol: BBoxCollection) -> None: ...
+    @overload
+    def add_rects(self, layer: str, purpose: str, boxes: numpy.ndarray) -> None: ...
+    @overload
+    def add_rects(self, layer_key: int, boxes: numpy.ndarray) -> None: ...
+    @overload
+    def add_rects(self, layer: str, purpose: str, boxes: BBoxBatch) -> None: ...
+    @overload
+    def add_rects(self, layer_key: int, boxes: BBoxBatch) -> None: ...
     def add_via(self, xform: Transform, via_id: str, params: ViaParam, add_layers: bool, commit: bool) -> PyVia: ...
     def add_via_arr(self, xform: Transform, via_id: str, params: ViaParam, add_layers: bool, nx: int, ny: int, spx: int, spy: int) -> None: ...
     def add_via_on_intersections(self, tid1: PyTrackID, tid2: PyTrackID, l1: int, u1: int, l2: int, u2: int, extend: bool, contain: bool) -> Tuple[Tuple[int, int], Tuple[int, int]]: ...
+    def add_vias_on_intersections(self, tids1: List[PyTrackID], tids2: List[PyTrackID], lowers1: numpy.ndarray, uppers1: numpy.ndarray, lowers2: numpy.ndarray, uppers2: numpy.ndarray, extend: bool, contain: bool) -> numpy.ndarray: ...
     def add_warr(self, tid: PyTrackID, lower: int, upper: int, is_dummy: bool = False) -> None: ...
+    def add_warrs(self, tids: List[PyTrackID], lowers: numpy.ndarray, uppers: numpy.ndarray, is_dummy: bool = False) -> None: ...
+    def clone(self) -> PyLayCellView: ...
+    @overload
     def connect_barr_to_tracks(self, lev_code: int, layer: str, purpose: str, barr: BBoxArray, tid: PyTrackID, tr_lower: Optional[int], tr_upper: Optional[int], min_len_code: int, w_lower: Optional[int], w_upper: Optional[int]) -> Tuple[Tuple[int, int], Tuple[int, int]]: ...
+    @overload
+    def connect_barr_to_tracks(self, lev_code: int, layer_key: int, barr: BBoxArray, tid: PyTrackID, tr_lower: Optional[int], tr_upper: Optional[int], min_len_code: int, w_lower: Optional[int], w_upper: Optional[int]) -> Tuple[Tuple[int, int], Tuple[int, int]]: ...
     def connect_warr_to_tracks(self, w_tid: PyTrackID, tid: PyTrackID, w_lower: int, w_upper: int) -> Tuple[Tuple[int, int], Tuple[int, int]]: ...
+    def count_intersect(self, layer: int, bnd_box: BBox, spx: int, spy: int, no_sp: bool) -> int: ...
     def do_max_space_fill(self, level: int, bbox: BBox, fill_boundary: bool, fill_info: Tuple[int, int, int, int, float]) -> None: ...
+    def flatten(self, levels: List[int], num_threads: int = 0) -> Dict[int, numpy.ndarray]: ...
     def get_intersect(self, layer: int, bnd_box: BBox, spx: int, spy: int, no_sp: bool) -> List[BBox]: ...
+    def get_intersect_array(self, layer: int, bnd_box: BBox, spx: int, spy: int, no_sp: bool) -> numpy.ndarray: ...
+    def get_intersect_batch(self, layer: int, bnd_boxes: numpy.ndarray, spx: int, spy: int, no_sp: bool) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def get_intersect_hier(self, layer: int, bnd_box: BBox, spx: int, spy: int, no_sp: bool) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
     def get_rect_bbox(self, layer: str, purpose: str) -> BBox: ...
+    def has_intersect(self, layer: int, bnd_box: BBox, spx: int, spy: int, no_sp: bool) -> bool: ...
     def set_grid(self, grid: PyRoutingGrid) -> None: ...
 
 
+class PyLayInstGroup:
+    def __init__(self, refs: List[PyLayInstRef]) -> None: ...
+    def __len__(self) -> int: ...
+    @overload
+    def move_by(self, dx: int, dy: int) -> None: ...
+    @overload
+    def move_by(self, offsets: numpy.ndarray) -> None: ...
+    def set_master(self, new_master: PyLayCellView) -> None: ...
+    def set_xforms(self, xforms: numpy.ndarray) -> None: ...
+    def transform(self, xform: Transform) -> None: ...
+
+
 class PyLayInstRef:
     @property
     def committed(self) -> bool: ...
@@ -482,15 +589,28 @@ class PyTech:
     def use_track_coloring(self) -> bool: ...
     def __init__(self, tech_fname: str) -> None: ...
     def get_lay_purp_list(self, layer_id: int) -> List[Tuple[str, str]]: ...
+    @overload
     def get_layer_id(self, layer: str, purpose: str = '') -> Optional[int]: ...
+    @overload
+    def get_layer_id(self, layer_key: int) -> Optional[int]: ...
     def get_metal_em_specs(self, layer: str, purpose: str, width: int, length: int = -1, vertical: bool = False, dc_temp: int = -1000, rms_dt: int = -1000) -> Tuple[float, float, float]: ...
+    @overload
     def get_min_line_end_space(self, layer: str, width: int, purpose: str = '', even: bool = False) -> int: ...
+    @overload
+    def get_min_line_end_space(self, layer_key: int, width: int, even: bool = False) -> int: ...
+    @overload
     def get_min_space(self, layer: str, width: int, purpose: str = '', same_color: bool = False, even: bool = False) -> int: ...
+    @overload
+    def get_min_space(self, layer_key: int, width: int, same_color: bool = False, even: bool = False) -> int: ...
     def get_next_length(self, layer: str, purpose: str, tr_dir_code: int, width: int, cur_len: int, even: bool = False) -> int: ...
     def get_prev_length(self, layer: str, purpose: str, tr_dir_code: int, width: int, cur_len: int, even: bool = False) -> int: ...
     def get_via_em_specs(self, layer_dir: int, layer: str, purpose: str, adj_layer: str, adj_purpose: str, cut_w: int, cut_h: int, m_w: int = -1, m_l: int = -1, adj_m_w: int = -1, adj_m_l: int = -1, array: bool = False, dc_temp: int = -1000, rms_dt: int = -1000) -> Tuple[float, float, float]: ...
+    @overload
     def get_via_id(self, lev_code: int, lay: str, purp: str, adj_lay: str, adj_purp: str) -> str: ...
+    @overload
+    def get_via_id(self, lev_code: int, layer_key: int, adj_layer_key: int) -> str: ...
     def get_via_param(self, w: int, h: int, via_id: str, lev_code: int, ex_dir: int, adj_ex_dir: int, extend: bool) -> ViaParam: ...
+    def layer_key(self, layer: str, purpose: str = '') -> int: ...
 
 
 class PyTrackID:
@@ -532,10 +652,99 @@ class RTree:
     def __bool__(self) -> bool: ...
     def __getitem__(self, obj_id: int) -> object: ...
     def __iter__(self) -> Iterator[Tuple[BBox, int]]: ...
+    def __len__(self) -> int: ...
+    def compact(self) -> None: ...
+    @overload
+    @staticmethod
+    def from_boxes(boxes: BBoxCollection, values: Optional[Iterable[object]] = None) -> RTree: ...
+    @overload
+    @staticmethod
+    def from_boxes(boxes: numpy.ndarray, values: Optional[Iterable[object]] = None) -> RTree: ...
+    def get_bbox(self, obj_id: int) -> BBox: ...
+    def get_values(self, ids: numpy.ndarray) -> List[object]: ...
     def insert(self, obj: object, box: BBox) -> int: ...
+    def intersect_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def intersect_ids(self, box: BBox) -> numpy.ndarray: ...
     def intersect_iter(self, box: BBox) -> Iterator[Tuple[BBox, int]]: ...
+    def nearest_batch(self, boxes: numpy.ndarray, k: int = 1, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def nearest_ids(self, box: BBox, k: int = 1) -> numpy.ndarray: ...
+    def overlap_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def overlap_ids(self, box: BBox) -> numpy.ndarray: ...
     def overlap_iter(self, box: BBox) -> Iterator[Tuple[BBox, int]]: ...
     def pop(self, obj_id: int) -> object: ...
+    def pop_many(self, ids: numpy.ndarray) -> List[object]: ...
+    def remove_in(self, box: BBox) -> numpy.ndarray: ...
+    def save(self, fname: str) -> None: ...
+    def within_batch(self, boxes: numpy.ndarray, dist: int, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def within_ids(self, box: BBox, dist: int) -> numpy.ndarray: ...
+
+
+class RTreeBox:
+    @property
+    def bound_box(self) -> BBox: ...
+    def __init__(self) -> None: ...
+    def __bool__(self) -> bool: ...
+    def __getitem__(self, obj_id: int) -> BBox: ...
+    def __iter__(self) -> Iterator[Tuple[BBox, int]]: ...
+    def __len__(self) -> int: ...
+    def compact(self) -> None: ...
+    @overload
+    @staticmethod
+    def from_boxes(boxes: BBoxCollection, values: Optional[numpy.ndarray] = None) -> RTreeBox: ...
+    @overload
+    @staticmethod
+    def from_boxes(boxes: numpy.ndarray, values: Optional[numpy.ndarray] = None) -> RTreeBox: ...
+    def get_bbox(self, obj_id: int) -> BBox: ...
+    def get_values(self, ids: numpy.ndarray) -> numpy.ndarray: ...
+    def insert(self, obj: BBox, box: BBox) -> int: ...
+    def intersect_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def intersect_ids(self, box: BBox) -> numpy.ndarray: ...
+    def intersect_iter(self, box: BBox) -> Iterator[Tuple[BBox, int]]: ...
+    def nearest_batch(self, boxes: numpy.ndarray, k: int = 1, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def nearest_ids(self, box: BBox, k: int = 1) -> numpy.ndarray: ...
+    def overlap_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def overlap_ids(self, box: BBox) -> numpy.ndarray: ...
+    def overlap_iter(self, box: BBox) -> Iterator[Tuple[BBox, int]]: ...
+    def pop(self, obj_id: int) -> BBox: ...
+    def pop_many(self, ids: numpy.ndarray) -> numpy.ndarray: ...
+    def remove_in(self, box: BBox) -> numpy.ndarray: ...
+    def save(self, fname: str) -> None: ...
+    def within_batch(self, boxes: numpy.ndarray, dist: int, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def within_ids(self, box: BBox, dist: int) -> numpy.ndarray: ...
+
+
+class RTreeInt:
+    @property
+    def bound_box(self) -> BBox: ...
+    def __init__(self) -> None: ...
+    def __bool__(self) -> bool: ...
+    def __getitem__(self, obj_id: int) -> int: ...
+    def __iter__(self) -> Iterator[Tuple[BBox, int]]: ...
+    def __len__(self) -> int: ...
+    def compact(self) -> None: ...
+    @overload
+    @staticmethod
+    def from_boxes(boxes: BBoxCollection, values: Optional[numpy.ndarray] = None) -> RTreeInt: ...
+    @overload
+    @staticmethod
+    def from_boxes(boxes: numpy.ndarray, values: Optional[numpy.ndarray] = None) -> RTreeInt: ...
+    def get_bbox(self, obj_id: int) -> BBox: ...
+    def get_values(self, ids: numpy.ndarray) -> numpy.ndarray: ...
+    def insert(self, obj: int, box: BBox) -> int: ...
+    def intersect_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def intersect_ids(self, box: BBox) -> numpy.ndarray: ...
+    def intersect_iter(self, box: BBox) -> Iterator[Tuple[BBox, int]]: ...
+    def nearest_batch(self, boxes: numpy.ndarray, k: int = 1, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def nearest_ids(self, box: BBox, k: int = 1) -> numpy.ndarray: ...
+    def overlap_batch(self, boxes: numpy.ndarray, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def overlap_ids(self, box: BBox) -> numpy.ndarray: ...
+    def overlap_iter(self, box: BBox) -> Iterator[Tuple[BBox, int]]: ...
+    def pop(self, obj_id: int) -> int: ...
+    def pop_many(self, ids: numpy.ndarray) -> numpy.ndarray: ...
+    def remove_in(self, box: BBox) -> numpy.ndarray: ...
+    def save(self, fname: str) -> None: ...
+    def within_batch(self, boxes: numpy.ndarray, dist: int, num_threads: int = 1) -> Tuple[numpy.ndarray, numpy.ndarray]: ...
+    def within_ids(self, box: BBox, dist: int) -> numpy.ndarray: ...
 
 
 class TrackColoring:
@@ -46,6 +46,7 @@ limitations under the License.
 
 #include <pybag/bbox.h>
 #include <pybag/bbox_array.h>
+#include <pybag/bbox_batch.h>
 #include <pybag/bbox_collection.h>
 #include <pybag/geometry.h>
 
@@ -53,8 +54,10 @@ void bind_geometry(py::module &m) {
     auto py_box = py::class_<c_box>(m, "BBox");
     auto py_barr = py::class_<c_box_arr>(m, "BBoxArray");
     auto py_bcol = py::class_<c_box_col>(m, "BBoxCollection");
+    auto py_bbatch = py::class_<c_box_batch>(m, "BBoxBatch");
 
     bind_bbox(py_box);
     bind_bbox_array(py_barr);
     bind_bbox_collection(py_bcol);
+    bind_bbox_batch(py_bbatch);
 }
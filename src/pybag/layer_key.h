@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+Copyright 2020 Blue Cheetah Analog Design Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef PYBAG_LAYER_KEY_H
+#define PYBAG_LAYER_KEY_H
+
+#include <cstdint>
+
+#include <cbag/common/layer_t.h>
+
+namespace pybag {
+namespace util {
+
+/** An opaque integer handle for a layer/purpose pair, returned by PyTech.layer_key().
+ *
+ *  The handle packs the layer and purpose IDs, so converting it back to a layer_t needs no
+ *  lookup.  A handle is only meaningful for the technology that created it.
+ */
+using py_layer_key = std::uint64_t;
+
+inline py_layer_key to_layer_key(const cbag::layer_t &key) {
+    return (static_cast<py_layer_key>(key.first) << 32) |
+           static_cast<py_layer_key>(static_cast<std::uint32_t>(key.second));
+}
+
+inline cbag::layer_t from_layer_key(py_layer_key key) {
+    return {static_cast<decltype(cbag::layer_t::first)>(key >> 32),
+            static_cast<decltype(cbag::layer_t::second)>(key & 0xFFFFFFFFU)};
+}
+
+} // namespace util
+} // namespace pybag
+
+#endif
@@ -44,6 +44,28 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/geometry.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include <fmt/core.h>
+
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
@@ -54,13 +76,21 @@ limitations under the License.
 #include <cbag/layout/grid_object.h>
 #include <cbag/layout/instance.h>
 #include <cbag/layout/path_util.h>
+#include <cbag/layout/routing_grid.h>
+#include <cbag/layout/track_coloring.h>
 #include <cbag/layout/via_wrapper.h>
+#include <cbag/polygon/boost_adapt.h>
 
 #include <pybag/bbox_array.h>
+#include <pybag/bbox_batch.h>
+#include <pybag/layer_key.h>
 #include <pybag/layout.h>
+#include <pybag/numpy_util.h>
+#include <pybag/parallel.h>
 #include <pybag/py_pt_vector.h>
 
 namespace pyg = pybind11_generics;
+namespace bgi = boost::geometry::index;
 
 using c_instance = cbag::layout::instance;
 using c_inst_ref = cbag::layout::cv_obj_ref<c_instance>;
@@ -69,52 +99,814 @@ using c_cellview = cbag::layout::cellview;
 namespace pybag {
 namespace lay {
 
-void check_ref(const c_inst_ref &ref) {
+// what is needed to record an instance in its parent cellview when it is committed.
+struct inst_info {
+    std::weak_ptr<c_cellview> parent;
+    // the master, or null for primitive instances.
+    std::shared_ptr<const c_cellview> master;
+    // the library, cell and view names of primitive instances.
+    std::array<std::string, 3> prim_name;
+    bool recorded = false;
+};
+
+/** A layout instance reference.
+ *
+ *  cbag commits instances without notifying pybag, so commits go through here to update the
+ *  content hash and instance list of the parent cellview.  Copies share the same inst_info, so
+ *  an instance is recorded once however many references commit it.
+ */
+struct inst_ref {
+    c_inst_ref ref;
+    std::shared_ptr<inst_info> info;
+
+    decltype(auto) operator->() { return ref.operator->(); }
+    decltype(auto) operator->() const { return ref.operator->(); }
+    bool editable() const { return ref.editable(); }
+};
+
+void check_ref(const inst_ref &ref) {
     if (!ref.editable()) {
         throw std::runtime_error("Cannot modify committed instance");
     }
 }
 
-cbag::cnt_t get_nx(const c_inst_ref &ref) { return ref->nx; }
-cbag::cnt_t get_ny(const c_inst_ref &ref) { return ref->ny; }
-cbag::offset_t get_spx(const c_inst_ref &ref) { return ref->spx; }
-cbag::offset_t get_spy(const c_inst_ref &ref) { return ref->spy; }
-const cbag::transformation &get_xform(const c_inst_ref &ref) { return ref->xform; }
+cbag::cnt_t get_nx(const inst_ref &ref) { return ref->nx; }
+cbag::cnt_t get_ny(const inst_ref &ref) { return ref->ny; }
+cbag::offset_t get_spx(const inst_ref &ref) { return ref->spx; }
+cbag::offset_t get_spy(const inst_ref &ref) { return ref->spy; }
+const cbag::transformation &get_xform(const inst_ref &ref) { return ref->xform; }
 
-void set_nx(c_inst_ref &ref, cbag::scnt_t val) {
+void set_nx(inst_ref &ref, cbag::scnt_t val) {
     check_ref(ref);
     if (val < 0)
         throw std::runtime_error("Cannot set nx to be negative.");
     ref->nx = val;
 }
-void set_ny(c_inst_ref &ref, cbag::scnt_t val) {
+void set_ny(inst_ref &ref, cbag::scnt_t val) {
     check_ref(ref);
     if (val < 0)
         throw std::runtime_error("Cannot set nx to be negative.");
     ref->ny = val;
 }
-void set_spx(c_inst_ref &ref, cbag::offset_t val) {
+void set_spx(inst_ref &ref, cbag::offset_t val) {
     check_ref(ref);
     ref->spx = val;
 }
-void set_spy(c_inst_ref &ref, cbag::offset_t val) {
+void set_spy(inst_ref &ref, cbag::offset_t val) {
     check_ref(ref);
     ref->spy = val;
 }
 
-void move_by(c_inst_ref &ref, cbag::offset_t dx, cbag::offset_t dy) {
+void move_by(inst_ref &ref, cbag::offset_t dx, cbag::offset_t dy) {
     check_ref(ref);
     ref->xform.move_by(dx, dy);
 }
 
-void transform(c_inst_ref &ref, const cbag::transformation &xform) {
+void transform(inst_ref &ref, const cbag::transformation &xform) {
     check_ref(ref);
     ref->xform += xform;
 }
 
-void set_master(c_inst_ref &ref, const std::shared_ptr<const cbag::layout::cellview> &new_master) {
+void set_master(inst_ref &ref, const std::shared_ptr<const cbag::layout::cellview> &new_master) {
     check_ref(ref);
     ref->set_master(new_master);
+    ref.info->master = new_master;
+}
+
+/** A group of uncommitted instances that are edited together.
+ *
+ *  Every instance is checked before any is changed, so an edit either applies to all instances
+ *  or raises without changing any.
+ */
+class inst_group {
+  private:
+    std::vector<inst_ref> refs_;
+
+    void check_all() const {
+        for (const auto &ref : refs_) {
+            check_ref(ref);
+        }
+    }
+
+    void check_rows(const util::py_coord_array &arr, py::ssize_t num_col) const {
+        if (arr.ndim() != 2 || arr.shape(1) != num_col ||
+            static_cast<std::size_t>(arr.shape(0)) != refs_.size())
+            throw std::invalid_argument(fmt::format(
+                "Expected a ({}, {}) array for {} instances.", refs_.size(), num_col,
+                refs_.size()));
+    }
+
+  public:
+    explicit inst_group(std::vector<inst_ref> refs) : refs_(std::move(refs)) {}
+
+    std::size_t size() const noexcept { return refs_.size(); }
+
+    void move_by(cbag::offset_t dx, cbag::offset_t dy) {
+        check_all();
+        py::gil_scoped_release release;
+        for (auto &ref : refs_) {
+            ref->xform.move_by(dx, dy);
+        }
+    }
+
+    // moves the i-th instance by the i-th [dx, dy] row of the given (N, 2) array.
+    void move_by(const util::py_coord_array &offsets) {
+        check_rows(offsets, 2);
+        check_all();
+        auto *data = offsets.data();
+        py::gil_scoped_release release;
+        for (auto &ref : refs_) {
+            ref->xform.move_by(data[0], data[1]);
+            data += 2;
+        }
+    }
+
+    void transform(const cbag::transformation &xform) {
+        check_all();
+        py::gil_scoped_release release;
+        for (auto &ref : refs_) {
+            ref->xform += xform;
+        }
+    }
+
+    // sets the transformation of the i-th instance to the i-th [dx, dy, orient_code] row.
+    void set_xforms(const util::py_coord_array &xforms) {
+        check_rows(xforms, 3);
+        check_all();
+        auto *data = xforms.data();
+        py::gil_scoped_release release;
+        for (auto &ref : refs_) {
+            ref->xform =
+                cbag::transformation(data[0], data[1], static_cast<cbag::orientation>(data[2]));
+            data += 3;
+        }
+    }
+
+    void set_master(const std::shared_ptr<const cbag::layout::cellview> &new_master) {
+        check_all();
+        for (auto &ref : refs_) {
+            ref->set_master(new_master);
+            ref.info->master = new_master;
+        }
+    }
+};
+
+// the kinds of objects mixed into content hashes.
+enum class hash_tag : std::uint64_t {
+    untracked = 1,
+    rect = 2,
+    warr = 3,
+    via = 4,
+    prim_inst = 5,
+    inst = 6,
+    pin = 7,
+    label = 8,
+    xform = 9,
+    grid = 10,
+};
+
+// the splitmix64 finalizer.
+inline std::uint64_t mix_hash(std::uint64_t val) {
+    val = (val ^ (val >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    val = (val ^ (val >> 27)) * 0x94d049bb133111ebULL;
+    return val ^ (val >> 31);
+}
+
+template <class... Ts> std::uint64_t hash_of(hash_tag tag, Ts... vals) {
+    auto ans = mix_hash(static_cast<std::uint64_t>(tag));
+    ((ans = mix_hash(ans ^ (static_cast<std::uint64_t>(vals) + 0x9e3779b97f4a7c15ULL))), ...);
+    return ans;
+}
+
+inline std::uint64_t hash_str(const std::string &val) { return std::hash<std::string>{}(val); }
+
+inline std::uint64_t hash_xform(const cbag::transformation &xform) {
+    return hash_of(hash_tag::xform, x(xform), y(xform),
+                   static_cast<cbag::orient_t>(xform.orient()));
+}
+
+// a committed instance of a layout cellview.
+struct inst_record {
+    std::shared_ptr<const c_cellview> master;
+    cbag::transformation xform;
+    cbag::cnt_t nx = 1;
+    cbag::cnt_t ny = 1;
+    cbag::offset_t spx = 0;
+    cbag::offset_t spy = 0;
+};
+
+/** Bounding boxes of the geometry of a cellview itself, per level.
+ *
+ *  Entries are stored with the content hash of the cellview, so they are only reused while its
+ *  content has not changed.  Queries fill this cache and may run concurrently, so it is locked.
+ */
+class own_bound_cache {
+  private:
+    using level_map = std::map<cbag::level_t, std::pair<std::uint64_t, cbag::box_t>>;
+
+    mutable std::mutex lock_;
+    level_map table_;
+
+    level_map get_table() const {
+        auto guard = std::lock_guard<std::mutex>(lock_);
+        return table_;
+    }
+
+  public:
+    own_bound_cache() = default;
+
+    own_bound_cache(const own_bound_cache &rhs) : table_(rhs.get_table()) {}
+
+    own_bound_cache &operator=(const own_bound_cache &rhs) {
+        auto table = rhs.get_table();
+        auto guard = std::lock_guard<std::mutex>(lock_);
+        table_ = std::move(table);
+        return *this;
+    }
+
+    std::optional<cbag::box_t> get(cbag::level_t level, std::uint64_t hash) const {
+        auto guard = std::lock_guard<std::mutex>(lock_);
+        auto iter = table_.find(level);
+        if (iter == table_.end() || iter->second.first != hash)
+            return {};
+        return iter->second.second;
+    }
+
+    void set(cbag::level_t level, std::uint64_t hash, const cbag::box_t &box) {
+        auto guard = std::lock_guard<std::mutex>(lock_);
+        table_[level] = {hash, box};
+    }
+};
+
+/** The state pybag keeps for a cellview.
+ *
+ *  The content hash is the sum of the hashes of the objects of the cellview, so it does not depend
+ *  on the order the objects are added in.  Rectangle arrays are hashed as a whole, so an array and
+ *  its rectangles added one by one hash differently.  cbag cellviews have no change hooks, so a
+ *  cellview changed by a binding that does not hash its objects is marked untracked.  The hash is
+ *  seeded with the routing grid and track coloring, but wires are hashed by their TrackID and
+ *  coordinates, and instances by the hash their master had when they were added.  Equal hashes
+ *  are therefore only a hint; use operator== to confirm two cellviews are equal.
+ *
+ *  cbag does not expose the instances of a cellview, so committed instances are recorded here for
+ *  hierarchical operations.  Uncommitted instances may still change, so they are recorded when
+ *  committed.
+ *
+ *  Like the cellview, this state is not synchronized, except for the bound cache.
+ */
+struct cv_state {
+    std::uint64_t hash = 0;
+    bool tracked = true;
+    std::vector<inst_record> insts;
+    own_bound_cache own_bounds;
+};
+
+// a cellview allocated together with its state.
+struct tracked_cellview {
+    c_cellview cv;
+    cv_state state;
+
+    template <class... Args>
+    explicit tracked_cellview(Args &&... args) : cv(std::forward<Args>(args)...) {}
+};
+
+// the deleter of cellviews created by pybag, which owns the tracked_cellview.
+struct tracked_deleter {
+    tracked_cellview *ptr = nullptr;
+
+    void operator()(c_cellview *) const { delete ptr; }
+};
+
+/** Creates a cellview with its own state from the given cellview constructor arguments.
+ *
+ *  The state is found again from any shared_ptr to the cellview through its deleter, so no
+ *  global table or lock is needed.
+ */
+template <class... Args> std::shared_ptr<c_cellview> make_tracked(Args &&... args) {
+    auto *ptr = new tracked_cellview(std::forward<Args>(args)...);
+    return std::shared_ptr<c_cellview>(&ptr->cv, tracked_deleter{ptr});
+}
+
+// returns the state of the given cellview, or null if it was not created by pybag (e.g. read from
+// GDS).  Instances added to such cellviews are not recorded.
+cv_state *get_state(const std::shared_ptr<const c_cellview> &cv_ptr) {
+    auto *del = std::get_deleter<tracked_deleter>(cv_ptr);
+    return del ? &del->ptr->state : nullptr;
+}
+
+// starts tracking the content hash of the given empty cellview.
+void track_content_hash(const std::shared_ptr<const c_cellview> &cv_ptr) {
+    auto &state = *get_state(cv_ptr);
+    state.hash = hash_of(hash_tag::grid, cv_ptr->get_grid()->get_hash(),
+                         cv_ptr->get_tr_colors()->get_hash());
+    state.tracked = true;
+}
+
+void add_content_hash(const std::shared_ptr<const c_cellview> &cv_ptr, std::uint64_t val) {
+    if (auto *state = get_state(cv_ptr))
+        state->hash += val;
+}
+
+void invalidate_content_hash(const std::shared_ptr<const c_cellview> &cv_ptr) {
+    if (auto *state = get_state(cv_ptr))
+        state->tracked = false;
+}
+
+// returns the content hash of the given cellview, or nullopt if it is untracked.
+std::optional<std::uint64_t> get_tracked_hash(const std::shared_ptr<const c_cellview> &cv_ptr) {
+    auto *state = get_state(cv_ptr);
+    return (state && state->tracked) ? std::optional<std::uint64_t>(state->hash) : std::nullopt;
+}
+
+// returns the content hash of the given cellview; untracked cellviews hash by identity.
+std::uint64_t get_content_hash(const std::shared_ptr<const c_cellview> &cv_ptr) {
+    if (auto ans = get_tracked_hash(cv_ptr))
+        return *ans;
+    return hash_of(hash_tag::untracked, reinterpret_cast<std::uintptr_t>(cv_ptr.get()));
+}
+
+// returns the committed instances of the given cellview recorded by pybag.
+const std::vector<inst_record> &get_instances(const std::shared_ptr<const c_cellview> &cv_ptr) {
+    static const std::vector<inst_record> empty;
+    auto *state = get_state(cv_ptr);
+    return state ? state->insts : empty;
+}
+
+// calls fun with the given cellview, passed as a reference or a pointer as fun expects.
+template <class R, class CV, class... Args, class... Ts>
+R call_cv(R (*fun)(CV, Args...), const std::shared_ptr<c_cellview> &cv_ptr, Ts &&... args) {
+    if constexpr (std::is_same_v<std::decay_t<CV>, c_cellview>)
+        return fun(*cv_ptr, std::forward<Ts>(args)...);
+    else
+        return fun(cv_ptr, std::forward<Ts>(args)...);
+}
+
+/** Wraps the given cellview function to update the content hash of the cellview.
+ *
+ *  hasher is called with the cellview and the other arguments of fun, and returns the hash of the
+ *  added object, or nullopt if the object cannot be hashed.
+ */
+template <class R, class CV, class... Args, class Hasher>
+auto hashed(R (*fun)(CV, Args...), Hasher hasher) {
+    return [fun, hasher](const std::shared_ptr<c_cellview> &cv_ptr, Args... args) -> R {
+        std::optional<std::uint64_t> val = hasher(*cv_ptr, args...);
+        if (!val)
+            invalidate_content_hash(cv_ptr);
+        if constexpr (std::is_void_v<R>) {
+            call_cv(fun, cv_ptr, args...);
+            if (val)
+                add_content_hash(cv_ptr, *val);
+        } else {
+            auto ans = call_cv(fun, cv_ptr, args...);
+            if (val)
+                add_content_hash(cv_ptr, *val);
+            return ans;
+        }
+    };
+}
+
+// wraps the given cellview function to mark the cellview as untracked.
+template <class R, class CV, class... Args> auto untracked(R (*fun)(CV, Args...)) {
+    return hashed(fun, [](const auto &...) { return std::optional<std::uint64_t>(); });
+}
+
+/** Returns the hash of the given rectangle array in constant time.
+ *
+ *  The array is hashed in canonical form, with nonnegative spacings and zero spacing along
+ *  dimensions with one element, so the same array hashes the same however it is written.
+ */
+std::uint64_t hash_rects(const cbag::layer_t &key, const c_box_arr &barr) {
+    if (barr.num[0] == 0 || barr.num[1] == 0)
+        return 0;
+    auto lo = std::array<cbag::coord_t, 2>{xl(barr.base), yl(barr.base)};
+    auto hi = std::array<cbag::coord_t, 2>{xh(barr.base), yh(barr.base)};
+    auto sp = barr.sp;
+    for (std::size_t d = 0; d < 2; ++d) {
+        if (barr.num[d] == 1) {
+            sp[d] = 0;
+        } else if (sp[d] < 0) {
+            auto delta = static_cast<cbag::offset_t>(barr.num[d] - 1) * sp[d];
+            lo[d] += delta;
+            hi[d] += delta;
+            sp[d] = -sp[d];
+        }
+    }
+    return hash_of(hash_tag::rect, util::to_layer_key(key), lo[0], lo[1], hi[0], hi[1],
+                   barr.num[0], barr.num[1], sp[0], sp[1]);
+}
+
+std::uint64_t hash_warr(const cbag::layout::track_id &tid, cbag::coord_t lower,
+                        cbag::coord_t upper, bool is_dummy) {
+    return hash_of(hash_tag::warr, tid.get_hash(), lower, upper, is_dummy);
+}
+
+std::uint64_t hash_via(const cbag::transformation &xform, const std::string &via_id,
+                       const cbag::layout::via_param &params, bool add_layers, cbag::cnt_t nx,
+                       cbag::cnt_t ny, cbag::offset_t spx, cbag::offset_t spy) {
+    return hash_of(hash_tag::via, hash_xform(xform), hash_str(via_id),
+                   hash_str(params.to_string()), add_layers, nx, ny, spx, spy);
+}
+
+std::uint64_t hash_inst(std::uint64_t master_hash, const std::string &name,
+                        const cbag::transformation &xform, cbag::cnt_t nx, cbag::cnt_t ny,
+                        cbag::offset_t spx, cbag::offset_t spy) {
+    return hash_of(hash_tag::inst, master_hash, hash_str(name), hash_xform(xform), nx, ny, spx,
+                   spy);
+}
+
+void add_shape(const std::shared_ptr<c_cellview> &cv_ptr, const cbag::layer_t &key,
+               const c_box_arr &barr) {
+    cv_ptr->add_shape(key, barr);
+    add_content_hash(cv_ptr, hash_rects(key, barr));
+}
+
+void add_shape(const std::shared_ptr<c_cellview> &cv_ptr, const cbag::layer_t &key,
+               const cbag::box_collection &bcol) {
+    cv_ptr->add_shape(key, bcol);
+    std::uint64_t hash = 0;
+    for (const auto &barr : bcol) {
+        hash += hash_rects(key, barr);
+    }
+    add_content_hash(cv_ptr, hash);
+}
+
+/** Adds n rectangles to the given layer, where get_box(idx) returns the idx-th rectangle.
+ *
+ *  All rectangles are added to the geometry index in one call with the GIL released, so get_box
+ *  must not touch Python objects.
+ */
+template <class GetBox>
+void add_rects(const std::shared_ptr<c_cellview> &cv_ptr, const cbag::layer_t &key,
+               std::size_t n, GetBox get_box) {
+    py::gil_scoped_release release;
+    auto bcol = cbag::box_collection();
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        bcol.append(get_box(idx), 1, 1, 0, 0);
+    }
+    add_shape(cv_ptr, key, bcol);
+}
+
+// adds the hash of a committed instance to its parent cellview, and records layout instances.
+void record_instance(const std::shared_ptr<c_cellview> &cv_ptr, const inst_info &info,
+                     const std::string &name, const cbag::transformation &xform, cbag::cnt_t nx,
+                     cbag::cnt_t ny, cbag::offset_t spx, cbag::offset_t spy) {
+    if (info.master) {
+        add_content_hash(cv_ptr,
+                         hash_inst(get_content_hash(info.master), name, xform, nx, ny, spx, spy));
+        if (auto *state = get_state(cv_ptr))
+            state->insts.push_back(inst_record{info.master, xform, nx, ny, spx, spy});
+    } else {
+        const auto &[lib, cell, view] = info.prim_name;
+        add_content_hash(cv_ptr, hash_of(hash_tag::prim_inst, hash_str(lib), hash_str(cell),
+                                         hash_str(view), hash_str(name), hash_xform(xform), nx,
+                                         ny, spx, spy));
+    }
+}
+
+// commits the given instance, and records it in its parent cellview the first time.
+void commit(inst_ref &ref) {
+    ref.ref.commit();
+    auto &info = *ref.info;
+    if (info.recorded)
+        return;
+    info.recorded = true;
+    if (auto cv_ptr = info.parent.lock())
+        record_instance(cv_ptr, info, ref->get_inst_name(), ref->xform, ref->nx, ref->ny,
+                        ref->spx, ref->spy);
+}
+
+inst_ref add_instance(const std::shared_ptr<c_cellview> &cv_ptr,
+                      const std::shared_ptr<const c_cellview> &master, const std::string &name,
+                      const cbag::transformation &xform, cbag::cnt_t nx, cbag::cnt_t ny,
+                      cbag::offset_t spx, cbag::offset_t spy, bool commit) {
+    auto ans = inst_ref{call_cv(&cbag::layout::add_instance, cv_ptr, master, name, xform, nx, ny,
+                                spx, spy, commit),
+                        std::make_shared<inst_info>(inst_info{cv_ptr, master, {}, commit})};
+    if (commit)
+        record_instance(cv_ptr, *ans.info, name, xform, nx, ny, spx, spy);
+    return ans;
+}
+
+inst_ref add_prim_instance(const std::shared_ptr<c_cellview> &cv_ptr, const std::string &lib,
+                           const std::string &cell, const std::string &view,
+                           const std::string &name, const cbag::transformation &xform,
+                           cbag::cnt_t nx, cbag::cnt_t ny, cbag::offset_t spx, cbag::offset_t spy,
+                           bool commit) {
+    auto ans = inst_ref{call_cv(&cbag::layout::add_prim_instance, cv_ptr, lib, cell, view, name,
+                                xform, nx, ny, spx, spy, commit),
+                        std::make_shared<inst_info>(
+                            inst_info{cv_ptr, nullptr, {lib, cell, view}, commit})};
+    if (commit)
+        record_instance(cv_ptr, *ans.info, name, xform, nx, ny, spx, spy);
+    return ans;
+}
+
+/** Adds one instance of master for each of the given names.
+ *
+ *  The i-th instance is placed with the transformation in the i-th [dx, dy, orient_code] row of
+ *  xforms.  Committed instances are recorded in the parent cellview with one insertion.  Returns
+ *  the instance references if return_refs is True, otherwise None.  Uncommitted instances can
+ *  only be committed through their references, so commit=False requires return_refs=True.
+ */
+std::optional<std::vector<inst_ref>>
+add_instances(const std::shared_ptr<c_cellview> &cv_ptr,
+              const std::shared_ptr<const c_cellview> &master,
+              const std::vector<std::string> &names, const util::py_coord_array &xforms,
+              cbag::cnt_t nx, cbag::cnt_t ny, cbag::offset_t spx, cbag::offset_t spy, bool commit,
+              bool return_refs) {
+    if (!commit && !return_refs)
+        throw std::invalid_argument(
+            "add_instances() with commit=False must set return_refs=True, otherwise the "
+            "instances can never be committed.");
+    auto n = names.size();
+    if (xforms.ndim() != 2 || xforms.shape(1) != 3 ||
+        static_cast<std::size_t>(xforms.shape(0)) != n)
+        throw std::invalid_argument(
+            fmt::format("Got {} names, but the transformation array is not a ({}, 3) array.", n,
+                        n));
+
+    auto *data = xforms.data();
+    auto refs = std::vector<inst_ref>();
+    {
+        py::gil_scoped_release release;
+        auto master_hash = get_content_hash(master);
+        auto records = std::vector<inst_record>();
+        std::uint64_t hash = 0;
+        if (commit)
+            records.reserve(n);
+        if (return_refs)
+            refs.reserve(n);
+        for (std::size_t idx = 0; idx < n; ++idx, data += 3) {
+            auto xform =
+                cbag::transformation(data[0], data[1], static_cast<cbag::orientation>(data[2]));
+            auto ref = call_cv(&cbag::layout::add_instance, cv_ptr, master, names[idx], xform, nx,
+                               ny, spx, spy, commit);
+            if (commit) {
+                hash += hash_inst(master_hash, names[idx], xform, nx, ny, spx, spy);
+                records.push_back(inst_record{master, xform, nx, ny, spx, spy});
+            }
+            if (return_refs) {
+                auto info = std::make_shared<inst_info>(inst_info{cv_ptr, master, {}, commit});
+                refs.push_back(inst_ref{std::move(ref), std::move(info)});
+            }
+        }
+        if (commit) {
+            add_content_hash(cv_ptr, hash);
+            if (auto *state = get_state(cv_ptr))
+                state->insts.insert(state->insts.end(), std::make_move_iterator(records.begin()),
+                                    std::make_move_iterator(records.end()));
+        }
+    }
+    if (return_refs)
+        return refs;
+    return {};
+}
+
+cbag::layer_t get_layer_t(const c_cellview &cv, const std::string &layer,
+                          const std::string &purpose) {
+    return cbag::layout::layer_t_at(*(cv.get_tech()), layer, purpose);
+}
+
+/** Adds a rectangle on the given layer, and returns the cbag reference to it.
+ *
+ *  The layer is resolved by the caller, so the reference and the content hash share one lookup.
+ */
+cbag::layout::shape_ref<cbag::box_t> add_rect(const std::shared_ptr<c_cellview> &cv_ptr,
+                                              const cbag::layer_t &key, const cbag::box_t &bbox,
+                                              bool commit) {
+    auto ans = cbag::layout::shape_ref<cbag::box_t>(cv_ptr.get(), key, cbag::box_t(bbox), commit);
+    if (commit)
+        add_content_hash(cv_ptr, hash_rects(key, c_box_arr{bbox, {1, 1}, {0, 0}}));
+    else
+        invalidate_content_hash(cv_ptr);
+    return ans;
+}
+
+auto connect_barr_to_tracks(c_cellview &cv, cbag::enum_t lev_code, const cbag::layer_t &key,
+                            const c_box_arr &barr, const cbag::layout::track_id &tid,
+                            std::optional<cbag::coord_t> tr_lower,
+                            std::optional<cbag::coord_t> tr_upper, int min_len_code,
+                            std::optional<cbag::coord_t> w_lower,
+                            std::optional<cbag::coord_t> w_upper) {
+    auto vdir = static_cast<cbag::direction_1d>(lev_code);
+    auto mode = static_cast<cbag::min_len_mode>(min_len_code);
+    return cbag::layout::connect_box_track(cv, vdir, key, barr.base, barr.num, barr.sp, tid,
+                                           {w_lower, w_upper}, {tr_lower, tr_upper}, mode);
+}
+
+/** Collects the rectangles of many wires, then adds them to a cellview with one call per layer.
+ *
+ *  The rectangles of a wire only depend on its TrackID and length, and moving the wire along its
+ *  track moves every rectangle by the same amount.  So the grid lookups (track info, wire widths
+ *  and coloring) run once per distinct TrackID and length, and other wires reuse the result.
+ */
+class warr_rects {
+  private:
+    using rect_list = std::vector<std::pair<cbag::layer_t, cbag::box_t>>;
+
+    struct wire_key {
+        cbag::layout::track_id tid;
+        cbag::offset_t length;
+
+        bool operator==(const wire_key &rhs) const {
+            return length == rhs.length && tid == rhs.tid;
+        }
+    };
+
+    struct wire_key_hash {
+        std::size_t operator()(const wire_key &key) const {
+            return static_cast<std::size_t>(
+                hash_of(hash_tag::warr, key.tid.get_hash(), key.length));
+        }
+    };
+
+    const cbag::layout::routing_grid &grid_;
+    const cbag::layout::track_coloring &colors_;
+    std::unordered_map<wire_key, rect_list, wire_key_hash> cache_;
+    std::map<cbag::layer_t, cbag::box_collection> rects_;
+
+  public:
+    explicit warr_rects(const c_cellview &cv)
+        : grid_(*cv.get_grid()), colors_(*cv.get_tr_colors()) {}
+
+    void add(const cbag::layout::track_id &tid, cbag::coord_t lower, cbag::coord_t upper) {
+        auto length = static_cast<cbag::offset_t>(upper) - lower;
+        auto [iter, inserted] = cache_.try_emplace(wire_key{tid, length});
+        auto &wire = iter->second;
+        if (inserted) {
+            auto stop = cbag::layout::end_rect(tid);
+            for (auto rect_iter = cbag::layout::begin_rect(grid_, colors_, tid, 0, length);
+                 rect_iter != stop; ++rect_iter) {
+                auto [key, box] = *rect_iter;
+                wire.emplace_back(key, box);
+            }
+        }
+
+        auto tr_dir = grid_.track_info_at(tid.get_level()).get_direction();
+        for (const auto &[key, box] : wire) {
+            auto moved = box;
+            cbag::polygon::move_by_orient(moved, tr_dir, lower, 0);
+            rects_[key].append(moved, 1, 1, 0, 0);
+        }
+    }
+
+    void commit(c_cellview &cv) {
+        for (const auto &[key, bcol] : rects_) {
+            cv.add_shape(key, bcol);
+        }
+        rects_.clear();
+    }
+};
+
+void add_warrs(const std::shared_ptr<c_cellview> &cv_ptr,
+               const std::vector<cbag::layout::track_id> &tids,
+               const util::py_coord_array &lowers, const util::py_coord_array &uppers,
+               bool is_dummy) {
+    auto n = tids.size();
+    if (static_cast<std::size_t>(lowers.size()) != n ||
+        static_cast<std::size_t>(uppers.size()) != n)
+        throw std::invalid_argument(
+            fmt::format("Got {} TrackIDs, but {} lower and {} upper coordinates.", n,
+                        lowers.size(), uppers.size()));
+
+    auto *lo = lowers.data();
+    auto *hi = uppers.data();
+    py::gil_scoped_release release;
+    std::uint64_t hash = 0;
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        hash += hash_warr(tids[idx], lo[idx], hi[idx], is_dummy);
+    }
+    if (is_dummy) {
+        // dummy wires get their purpose inside cellview::add_warr().
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            cv_ptr->add_warr(tids[idx], lo[idx], hi[idx], true);
+        }
+    } else {
+        auto rects = warr_rects(*cv_ptr);
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            rects.add(tids[idx], lo[idx], hi[idx]);
+        }
+        rects.commit(*cv_ptr);
+    }
+    add_content_hash(cv_ptr, hash);
+}
+
+// the extent of a wire: the track direction, and its intervals along and across the track.
+struct wire_extent {
+    cbag::orientation_2d dir;
+    std::array<cbag::coord_t, 2> along;
+    std::array<cbag::coord_t, 2> across;
+};
+
+std::vector<wire_extent> get_wire_extents(const cbag::layout::routing_grid &grid,
+                                          const std::vector<cbag::layout::track_id> &tids,
+                                          const cbag::coord_t *lowers,
+                                          const cbag::coord_t *uppers) {
+    auto ans = std::vector<wire_extent>();
+    ans.reserve(tids.size());
+    for (std::size_t idx = 0; idx < tids.size(); ++idx) {
+        const auto &tid = tids[idx];
+        ans.push_back(wire_extent{grid.track_info_at(tid.get_level()).get_direction(),
+                                  {lowers[idx], uppers[idx]}, tid.get_bounds(grid)});
+    }
+    return ans;
+}
+
+bool overlaps(const std::array<cbag::coord_t, 2> &a, const std::array<cbag::coord_t, 2> &b) {
+    return a[0] <= b[1] && b[0] <= a[1];
+}
+
+// returns false only if the two wires are perpendicular and cannot touch.
+bool may_intersect(const wire_extent &a, const wire_extent &b) {
+    return a.dir == b.dir || (overlaps(a.along, b.across) && overlaps(a.across, b.along));
+}
+
+/** Adds vias on all intersections between the two given sets of wires.
+ *
+ *  The i-th wire of the first set is on tids1[i] and spans [lowers1[i], uppers1[i]], and similarly
+ *  for the second set.  Returns a (N1, N2, 2, 2) array, where [i, j] contains the result of
+ *  add_via_on_intersections() on the i-th and j-th wires.
+ *
+ *  The wire extents are computed once per wire, and pairs that cannot touch are skipped without
+ *  calling into cbag, so via parameters are only computed for wires that cross.  A skipped pair
+ *  returns its input coordinates.
+ *
+ *  Via parameters are not cached per width pair, because pybag cannot compute them from the
+ *  widths.  The via ID depends on the layer of each wire, and track coloring may give the wires
+ *  of one TrackID different layers.  cbag::layout::add_via_on_intersections() also takes the
+ *  wire coordinates with extend and contain, and returns updated coordinates.  The rules that
+ *  turn these into via parameters and new coordinates are internal to cbag, so pybag would have
+ *  to copy them with nothing to check the copy against.
+ */
+py::array_t<cbag::coord_t> add_vias_on_intersections(
+    const std::shared_ptr<c_cellview> &cv_ptr, const std::vector<cbag::layout::track_id> &tids1,
+    const std::vector<cbag::layout::track_id> &tids2, const util::py_coord_array &lowers1,
+    const util::py_coord_array &uppers1, const util::py_coord_array &lowers2,
+    const util::py_coord_array &uppers2, bool extend, bool contain) {
+    auto n1 = tids1.size();
+    auto n2 = tids2.size();
+    if (static_cast<std::size_t>(lowers1.size()) != n1 ||
+        static_cast<std::size_t>(uppers1.size()) != n1 ||
+        static_cast<std::size_t>(lowers2.size()) != n2 ||
+        static_cast<std::size_t>(uppers2.size()) != n2)
+        throw std::invalid_argument("Coordinate arrays must have one entry per TrackID.");
+    invalidate_content_hash(cv_ptr);
+
+    auto ans = py::array_t<cbag::coord_t>(std::array<py::ssize_t, 4>{
+        static_cast<py::ssize_t>(n1), static_cast<py::ssize_t>(n2), 2, 2});
+    auto *out = ans.mutable_data();
+    {
+        py::gil_scoped_release release;
+        const auto &grid = *cv_ptr->get_grid();
+        auto ext1 = get_wire_extents(grid, tids1, lowers1.data(), uppers1.data());
+        auto ext2 = get_wire_extents(grid, tids2, lowers2.data(), uppers2.data());
+        for (std::size_t i = 0; i < n1; ++i) {
+            const auto &coord1 = ext1[i].along;
+            for (std::size_t j = 0; j < n2; ++j, out += 4) {
+                const auto &coord2 = ext2[j].along;
+                auto tmp = std::array<std::array<cbag::coord_t, 2>, 2>{coord1, coord2};
+                if (may_intersect(ext1[i], ext2[j]))
+                    tmp = cbag::layout::add_via_on_intersections(*cv_ptr, tids1[i], tids2[j],
+                                                                 coord1, coord2, extend, contain);
+                out[0] = tmp[0][0];
+                out[1] = tmp[0][1];
+                out[2] = tmp[1][0];
+                out[3] = tmp[1][1];
+            }
+        }
+    }
+    return ans;
+}
+
+/** Returns a deep copy of the given cellview.
+ *
+ *  cbag has no explicit copy method for layout cellviews, so this uses the cellview copy
+ *  constructor, then checks that the copy does not share the geometry index of any routing level
+ *  with the source.  If it does, shapes added to the copy would appear in the source, so this
+ *  throws instead of returning the copy.
+ *
+ *  The copy starts with the same content hash and recorded instances as the source.  The recorded
+ *  instances hold their masters, so the copy keeps the masters alive but not the source.  All
+ *  geometry is copied; copy-on-write is not implemented.
+ */
+std::shared_ptr<c_cellview> clone(const std::shared_ptr<c_cellview> &cv_ptr) {
+    const auto &src = *cv_ptr;
+    auto ans = make_tracked(src);
+    const auto &dst = *ans;
+    const auto &grid = *src.get_grid();
+    for (auto level = grid.get_bot_level(); level <= grid.get_top_level(); ++level) {
+        auto src_index = src.get_geo_index(level);
+        auto dst_index = dst.get_geo_index(level);
+        if (src_index && dst_index && &*src_index == &*dst_index)
+            throw std::runtime_error(fmt::format(
+                "Copying cellview {} shares the geometry index of level {}.", src.get_name(),
+                level));
+    }
+    if (auto *state = get_state(cv_ptr))
+        *get_state(ans) = *state;
+    else
+        invalidate_content_hash(ans);
+    return ans;
 }
 
 pyg::List<cbag::box_t> get_intersect(const std::shared_ptr<c_cellview> &cv_ptr, cbag::level_t level,
@@ -127,14 +919,433 @@ pyg::List<cbag::box_t> get_intersect(const std::shared_ptr<c_cellview> &cv_ptr,
     return ans;
 }
 
+// appends the bounding boxes of all geometry on the given level intersecting test_box to ans.
+void append_intersect(const std::shared_ptr<c_cellview> &cv_ptr, cbag::level_t level,
+                      const cbag::box_t &test_box, cbag::offset_t spx, cbag::offset_t spy,
+                      bool no_sp, std::vector<cbag::box_t> &ans) {
+    auto &index = *(cv_ptr->get_geo_index(level));
+    apply_intersect(index, [&ans](const auto &v) { ans.emplace_back(get_bbox(v)); }, test_box, spx,
+                    spy, no_sp);
+}
+
+py::array_t<cbag::coord_t> get_intersect_array(const std::shared_ptr<c_cellview> &cv_ptr,
+                                               cbag::level_t level, const cbag::box_t &test_box,
+                                               cbag::offset_t spx, cbag::offset_t spy,
+                                               bool no_sp) {
+    auto ans = std::vector<cbag::box_t>();
+    {
+        py::gil_scoped_release release;
+        append_intersect(cv_ptr, level, test_box, spx, spy, no_sp, ans);
+    }
+    return util::boxes_to_numpy(ans);
+}
+
+std::size_t count_intersect(const std::shared_ptr<c_cellview> &cv_ptr, cbag::level_t level,
+                            const cbag::box_t &test_box, cbag::offset_t spx, cbag::offset_t spy,
+                            bool no_sp) {
+    py::gil_scoped_release release;
+    std::size_t ans = 0;
+    auto &index = *(cv_ptr->get_geo_index(level));
+    apply_intersect(index, [&ans](const auto &) { ++ans; }, test_box, spx, spy, no_sp);
+    return ans;
+}
+
+/** Returns true if any geometry on the given level intersects test_box.
+ *
+ *  apply_intersect() has no way to stop early, and the geometry index exposes no query iterator,
+ *  so this visits every hit.  The callback only sets a flag, so no boxes are materialized.
+ */
+bool has_intersect(const std::shared_ptr<c_cellview> &cv_ptr, cbag::level_t level,
+                   const cbag::box_t &test_box, cbag::offset_t spx, cbag::offset_t spy,
+                   bool no_sp) {
+    py::gil_scoped_release release;
+    auto &index = *(cv_ptr->get_geo_index(level));
+    auto ans = false;
+    apply_intersect(index, [&ans](const auto &) { ans = true; }, test_box, spx, spy, no_sp);
+    return ans;
+}
+
+/** Queries the geometry intersecting each of the given (N, 4) test boxes.
+ *
+ *  Returns the tuple (offsets, boxes), where the results of the i-th test box are
+ *  boxes[offsets[i]:offsets[i + 1]].
+ */
+std::pair<py::array_t<util::py_id_t>, py::array_t<cbag::coord_t>>
+get_intersect_batch(const std::shared_ptr<c_cellview> &cv_ptr, cbag::level_t level,
+                    const util::py_coord_array &test_boxes, cbag::offset_t spx,
+                    cbag::offset_t spy, bool no_sp) {
+    auto n = util::num_boxes(test_boxes);
+    auto *data = test_boxes.data();
+    auto offsets = std::vector<util::py_id_t>();
+    auto boxes = std::vector<cbag::box_t>();
+    {
+        py::gil_scoped_release release;
+        offsets.reserve(n + 1);
+        offsets.push_back(0);
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            append_intersect(cv_ptr, level, util::get_box(data, idx), spx, spy, no_sp, boxes);
+            offsets.push_back(static_cast<util::py_id_t>(boxes.size()));
+        }
+    }
+    return {util::to_numpy(std::move(offsets)), util::boxes_to_numpy(boxes)};
+}
+
+// flattened geometry of a cellview, with one list of boxes per requested level.
+using flat_geometry = std::vector<std::vector<cbag::box_t>>;
+
+/** Flattens cellview hierarchies into per-level bounding boxes.
+ *
+ *  The flattened geometry of each master is computed once and cached, then copied into each of
+ *  its instances.  The instances of each cellview are split among worker threads.
+ */
+class flattener {
+  private:
+    std::vector<cbag::level_t> levels_;
+    std::size_t num_threads_ = 0;
+    std::map<const c_cellview *, flat_geometry> cache_;
+
+    void append_own(const c_cellview &cv, flat_geometry &ans) const {
+        auto all_box = cbag::box_t{std::numeric_limits<cbag::coord_t>::min(),
+                                   std::numeric_limits<cbag::coord_t>::min(),
+                                   std::numeric_limits<cbag::coord_t>::max(),
+                                   std::numeric_limits<cbag::coord_t>::max()};
+        for (std::size_t k = 0; k < levels_.size(); ++k) {
+            auto &boxes = ans[k];
+            auto &index = *(cv.get_geo_index(levels_[k]));
+            apply_intersect(index, [&boxes](const auto &v) { boxes.emplace_back(get_bbox(v)); },
+                            all_box, 0, 0, true);
+        }
+    }
+
+    static void append_inst(const inst_record &inst, const flat_geometry &master_geo,
+                            flat_geometry &ans) {
+        for (std::size_t k = 0; k < master_geo.size(); ++k) {
+            auto &boxes = ans[k];
+            for (const auto &box : master_geo[k]) {
+                auto base = cbag::polygon::get_transform(box, inst.xform);
+                for (cbag::cnt_t j = 0; j < inst.ny; ++j) {
+                    for (cbag::cnt_t i = 0; i < inst.nx; ++i) {
+                        boxes.push_back(cbag::polygon::get_move_by(
+                            base, static_cast<cbag::offset_t>(i) * inst.spx,
+                            static_cast<cbag::offset_t>(j) * inst.spy));
+                    }
+                }
+            }
+        }
+    }
+
+    const flat_geometry &get(const std::shared_ptr<const c_cellview> &cv_ptr) {
+        auto iter = cache_.find(cv_ptr.get());
+        if (iter != cache_.end())
+            return iter->second;
+
+        const auto &insts = get_instances(cv_ptr);
+        // flatten all masters first, so the workers below only read the cache.
+        for (const auto &inst : insts) {
+            get(inst.master);
+        }
+
+        auto num_lev = levels_.size();
+        auto ans = flat_geometry(num_lev);
+        append_own(*cv_ptr, ans);
+
+        auto num_workers = util::get_num_workers(num_threads_, insts.size());
+        auto parts = std::vector<flat_geometry>(num_workers, flat_geometry(num_lev));
+        util::run_workers(num_workers, [&](std::size_t idx) {
+            auto [start, stop] = util::get_chunk(insts.size(), num_workers, idx);
+            for (auto inst_idx = start; inst_idx < stop; ++inst_idx) {
+                const auto &inst = insts[inst_idx];
+                append_inst(inst, cache_.at(inst.master.get()), parts[idx]);
+            }
+        });
+        for (auto &part : parts) {
+            for (std::size_t k = 0; k < num_lev; ++k) {
+                ans[k].insert(ans[k].end(), part[k].begin(), part[k].end());
+            }
+        }
+        return cache_.emplace(cv_ptr.get(), std::move(ans)).first->second;
+    }
+
+  public:
+    flattener(std::vector<cbag::level_t> levels, std::size_t num_threads)
+        : levels_(std::move(levels)), num_threads_(num_threads) {}
+
+    flat_geometry run(const std::shared_ptr<const c_cellview> &cv_ptr) {
+        get(cv_ptr);
+        return std::move(cache_.at(cv_ptr.get()));
+    }
+};
+
+// floor(a / b) for b > 0.
+inline std::int64_t floor_div(std::int64_t a, std::int64_t b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+/** Returns the [start, stop) range of idx in [0, n) where [lo, hi] shifted by idx * sp touches
+ *  [q_lo, q_hi].
+ */
+std::array<cbag::cnt_t, 2> get_array_range(cbag::coord_t lo, cbag::coord_t hi, cbag::coord_t q_lo,
+                                           cbag::coord_t q_hi, cbag::offset_t sp,
+                                           cbag::cnt_t n) {
+    // idx * sp must be in [a, b].
+    auto a = static_cast<std::int64_t>(q_lo) - hi;
+    auto b = static_cast<std::int64_t>(q_hi) - lo;
+    auto step = static_cast<std::int64_t>(sp);
+    if (step == 0)
+        return {0, (a <= 0 && 0 <= b) ? n : 0};
+    if (step < 0) {
+        std::swap(a, b);
+        a = -a;
+        b = -b;
+        step = -step;
+    }
+    auto start = std::max(-floor_div(-a, step), static_cast<std::int64_t>(0));
+    auto stop = std::min(floor_div(b, step) + 1, static_cast<std::int64_t>(n));
+    if (start >= stop)
+        return {0, 0};
+    return {static_cast<cbag::cnt_t>(start), static_cast<cbag::cnt_t>(stop)};
+}
+
+// returns the transformation of the (i, j)-th element of the given instance.
+cbag::transformation get_elem_xform(const inst_record &inst, cbag::cnt_t i, cbag::cnt_t j) {
+    return cbag::polygon::get_move_by(inst.xform, static_cast<cbag::offset_t>(i) * inst.spx,
+                                      static_cast<cbag::offset_t>(j) * inst.spy);
+}
+
+// returns box expanded by spx and spy, clipped to the coordinate range.
+cbag::box_t get_expand(const cbag::box_t &box, cbag::offset_t spx, cbag::offset_t spy) {
+    auto clip = [](std::int64_t val) {
+        return static_cast<cbag::coord_t>(
+            std::clamp(val, static_cast<std::int64_t>(std::numeric_limits<cbag::coord_t>::min()),
+                       static_cast<std::int64_t>(std::numeric_limits<cbag::coord_t>::max())));
+    };
+    return {clip(static_cast<std::int64_t>(xl(box)) - spx),
+            clip(static_cast<std::int64_t>(yl(box)) - spy),
+            clip(static_cast<std::int64_t>(xh(box)) + spx),
+            clip(static_cast<std::int64_t>(yh(box)) + spy)};
+}
+
+/** Queries the geometry on one level of a cellview hierarchy that intersects a box.
+ *
+ *  The query box is inverse-transformed into the frame of each instance master, and instances
+ *  whose bounding box does not touch it are skipped.  The instances of each cellview, their
+ *  bounding boxes and an RTree over them are gathered once per query, so each visit of a
+ *  cellview only looks at the instances near the query box.  The bounds of the geometry of each
+ *  cellview itself are cached across queries.
+ */
+class hier_query {
+  private:
+    using inst_tree = bgi::rtree<std::pair<cbag::box_t, std::size_t>, bgi::quadratic<32, 16>>;
+
+    // cellviews with fewer instances are scanned instead of indexed.
+    static constexpr std::size_t min_index_size = 16;
+
+    // the instances of a cellview, with their bounding boxes in its frame.
+    struct cv_info {
+        cbag::box_t bound;
+        const std::vector<inst_record> *insts = nullptr;
+        std::vector<cbag::box_t> inst_bounds;
+        // indexes the instances with valid bounds, if there are enough of them.
+        inst_tree tree;
+    };
+
+    cbag::level_t level_;
+    cbag::offset_t spx_;
+    cbag::offset_t spy_;
+    bool no_sp_;
+    std::map<const c_cellview *, cv_info> infos_;
+
+    std::vector<cbag::box_t> boxes_;
+    std::vector<cbag::transformation> xforms_;
+
+    cbag::box_t get_own_bound(const std::shared_ptr<const c_cellview> &cv_ptr) {
+        auto *state = get_state(cv_ptr);
+        auto hash = get_tracked_hash(cv_ptr);
+        if (hash) {
+            if (auto ans = state->own_bounds.get(level_, *hash))
+                return *ans;
+        }
+        auto ans = cbag::box_t::get_invalid_bbox();
+        auto all_box = cbag::box_t{std::numeric_limits<cbag::coord_t>::min(),
+                                   std::numeric_limits<cbag::coord_t>::min(),
+                                   std::numeric_limits<cbag::coord_t>::max(),
+                                   std::numeric_limits<cbag::coord_t>::max()};
+        auto &index = *(cv_ptr->get_geo_index(level_));
+        apply_intersect(index, [&ans](const auto &v) { ans |= get_bbox(v); }, all_box, 0, 0,
+                        true);
+        if (hash)
+            state->own_bounds.set(level_, *hash, ans);
+        return ans;
+    }
+
+    // returns the bounding box of all geometry in the given instance, in the parent frame.
+    cbag::box_t get_inst_bound(const inst_record &inst) {
+        auto ans = get_info(inst.master).bound;
+        if (!is_valid(ans))
+            return ans;
+        cbag::polygon::transform(ans, inst.xform);
+        return ans |= cbag::polygon::get_move_by(
+                   ans, static_cast<cbag::offset_t>(inst.nx - 1) * inst.spx,
+                   static_cast<cbag::offset_t>(inst.ny - 1) * inst.spy);
+    }
+
+    const cv_info &get_info(const std::shared_ptr<const c_cellview> &cv_ptr) {
+        auto iter = infos_.find(cv_ptr.get());
+        if (iter != infos_.end())
+            return iter->second;
+
+        auto ans = cv_info{get_own_bound(cv_ptr), &get_instances(cv_ptr), {}, {}};
+        auto num_inst = ans.insts->size();
+        ans.inst_bounds.reserve(num_inst);
+        for (const auto &inst : *ans.insts) {
+            ans.inst_bounds.push_back(get_inst_bound(inst));
+            ans.bound |= ans.inst_bounds.back();
+        }
+        if (num_inst >= min_index_size) {
+            auto items = std::vector<std::pair<cbag::box_t, std::size_t>>();
+            items.reserve(num_inst);
+            for (std::size_t idx = 0; idx < num_inst; ++idx) {
+                if (is_valid(ans.inst_bounds[idx]))
+                    items.emplace_back(ans.inst_bounds[idx], idx);
+            }
+            // the range constructor bulk loads the tree with the packing algorithm.
+            ans.tree = inst_tree(items);
+        }
+        return infos_.emplace(cv_ptr.get(), std::move(ans)).first->second;
+    }
+
+    // returns true if the given geometry bounding box may be a hit of the given query box.
+    bool may_touch(const cbag::box_t &bnd, const cbag::box_t &box, cbag::offset_t spx,
+                   cbag::offset_t spy) const {
+        return is_valid(bnd) && xl(bnd) - spx <= xh(box) && xl(box) <= xh(bnd) + spx &&
+               yl(bnd) - spy <= yh(box) && yl(box) <= yh(bnd) + spy;
+    }
+
+    // returns the indices of the instances that may have hits in the given box, in order.
+    std::vector<std::size_t> get_inst_hits(const cv_info &info, const cbag::box_t &box,
+                                           cbag::offset_t spx, cbag::offset_t spy) const {
+        auto ans = std::vector<std::size_t>();
+        if (info.tree.empty()) {
+            for (std::size_t idx = 0; idx < info.inst_bounds.size(); ++idx) {
+                if (may_touch(info.inst_bounds[idx], box, spx, spy))
+                    ans.push_back(idx);
+            }
+        } else {
+            info.tree.query(bgi::intersects(get_expand(box, spx, spy)),
+                            boost::make_function_output_iterator(
+                                [&ans](const auto &v) { ans.push_back(v.second); }));
+            std::sort(ans.begin(), ans.end());
+        }
+        return ans;
+    }
+
+    void run(const std::shared_ptr<const c_cellview> &cv_ptr, const cbag::box_t &box,
+             cbag::offset_t spx, cbag::offset_t spy, const cbag::transformation &xform) {
+        auto &index = *(cv_ptr->get_geo_index(level_));
+        apply_intersect(index,
+                        [this, &xform](const auto &v) {
+                            boxes_.push_back(cbag::polygon::get_transform(get_bbox(v), xform));
+                            xforms_.push_back(xform);
+                        },
+                        box, spx, spy, no_sp_);
+
+        const auto &info = get_info(cv_ptr);
+        for (auto inst_idx : get_inst_hits(info, box, spx, spy)) {
+            const auto &inst = (*info.insts)[inst_idx];
+            const auto &bnd = get_info(inst.master).bound;
+
+            auto base = cbag::polygon::get_transform(bnd, inst.xform);
+            auto irange = get_array_range(xl(base) - spx, xh(base) + spx, xl(box), xh(box),
+                                          inst.spx, inst.nx);
+            auto jrange = get_array_range(yl(base) - spy, yh(base) + spy, yl(box), yh(box),
+                                          inst.spy, inst.ny);
+            // spacing is along the axes of the master frame.
+            auto flip = cbag::swaps_xy(inst.xform.orient());
+            auto child_spx = flip ? spy : spx;
+            auto child_spy = flip ? spx : spy;
+            for (auto j = jrange[0]; j < jrange[1]; ++j) {
+                for (auto i = irange[0]; i < irange[1]; ++i) {
+                    auto elem_xform = get_elem_xform(inst, i, j);
+                    auto child_box = cbag::polygon::get_transform(
+                        box, cbag::polygon::get_inverse(elem_xform));
+                    auto child_xform = elem_xform;
+                    child_xform += xform;
+                    run(inst.master, child_box, child_spx, child_spy, child_xform);
+                }
+            }
+        }
+    }
+
+  public:
+    hier_query(cbag::level_t level, cbag::offset_t spx, cbag::offset_t spy, bool no_sp)
+        : level_(level), spx_(spx), spy_(spy), no_sp_(no_sp) {}
+
+    // appends all hits in the given box, in the frame of the given cellview.
+    void run(const std::shared_ptr<const c_cellview> &cv_ptr, const cbag::box_t &box) {
+        run(cv_ptr, box, spx_, spy_, cbag::transformation(0, 0, cbag::orientation::R0));
+    }
+
+    const std::vector<cbag::box_t> &get_boxes() const { return boxes_; }
+    const std::vector<cbag::transformation> &get_xforms() const { return xforms_; }
+};
+
+/** Queries the geometry on the given level of the hierarchy of the given cellview.
+ *
+ *  Returns the tuple (boxes, xforms), where boxes is a (N, 4) array of the bounding boxes of all
+ *  hits in the frame of the given cellview, and xforms is a (N, 3) array of [dx, dy, orient]
+ *  rows of the transformation from the frame of the cellview containing each hit.
+ */
+std::pair<py::array_t<cbag::coord_t>, py::array_t<cbag::coord_t>>
+get_intersect_hier(const std::shared_ptr<c_cellview> &cv_ptr, cbag::level_t level,
+                   const cbag::box_t &test_box, cbag::offset_t spx, cbag::offset_t spy,
+                   bool no_sp) {
+    auto query = hier_query(level, spx, spy, no_sp);
+    {
+        py::gil_scoped_release release;
+        query.run(cv_ptr, test_box);
+    }
+    const auto &xforms = query.get_xforms();
+    auto xform_arr = py::array_t<cbag::coord_t>(
+        std::array<py::ssize_t, 2>{static_cast<py::ssize_t>(xforms.size()), 3});
+    auto *ptr = xform_arr.mutable_data();
+    for (const auto &xform : xforms) {
+        ptr[0] = x(xform);
+        ptr[1] = y(xform);
+        ptr[2] = static_cast<cbag::coord_t>(static_cast<cbag::orient_t>(xform.orient()));
+        ptr += 3;
+    }
+    return {util::boxes_to_numpy(query.get_boxes()), xform_arr};
+}
+
+/** Flattens the hierarchy of the given cellview.
+ *
+ *  Returns a dictionary from each given level to a (N, 4) array of the bounding boxes of all
+ *  geometry on that level, in the frame of the given cellview.
+ */
+std::map<cbag::level_t, py::array_t<cbag::coord_t>>
+flatten(const std::shared_ptr<c_cellview> &cv_ptr, const std::vector<cbag::level_t> &levels,
+        std::size_t num_threads) {
+    auto geo = flat_geometry();
+    {
+        py::gil_scoped_release release;
+        geo = flattener(levels, num_threads).run(cv_ptr);
+    }
+    auto ans = std::map<cbag::level_t, py::array_t<cbag::coord_t>>();
+    for (std::size_t k = 0; k < levels.size(); ++k) {
+        ans.emplace(levels[k], util::boxes_to_numpy(geo[k]));
+    }
+    return ans;
+}
+
 } // namespace lay
 } // namespace pybag
 
 namespace pl = pybag::lay;
+namespace pu = pybag::util;
 
 void bind_inst_ref(py::module &m) {
 
-    auto py_cls = py::class_<c_inst_ref>(m, "PyLayInstRef");
+    auto py_cls = py::class_<pl::inst_ref>(m, "PyLayInstRef");
     py_cls.doc() = "A reference to a layout instance inside a cellview.";
     py_cls.def_property("nx", &pl::get_nx, &pl::set_nx, "Number of columns.");
     py_cls.def_property("ny", &pl::get_ny, &pl::set_ny, "Number of rows.");
@@ -142,98 +1353,302 @@ void bind_inst_ref(py::module &m) {
     py_cls.def_property("spy", &pl::get_spy, &pl::set_spy, "Row pitch.");
     py_cls.def_property_readonly("xform", &pl::get_xform, "The Transform object.");
     py_cls.def_property_readonly(
-        "inst_name", [](const c_inst_ref &ref) { return ref->get_inst_name(); }, "Instance name.");
-    py_cls.def_property_readonly("committed", [](const c_inst_ref &ref) { return !ref.editable(); },
+        "inst_name", [](const pl::inst_ref &ref) { return ref->get_inst_name(); },
+        "Instance name.");
+    py_cls.def_property_readonly("committed",
+                                 [](const pl::inst_ref &ref) { return !ref.editable(); },
                                  "True if this instance is committed.");
     py_cls.def("move_by", &pl::move_by, "Moves the instance.", py::arg("dx"), py::arg("dy"));
     py_cls.def("transform", &pl::transform, "Transforms the instance.", py::arg("xform"));
     py_cls.def("set_master", &pl::set_master, "Sets the instance master.", py::arg("new_master"));
-    py_cls.def("commit", &c_inst_ref::commit, "Commits the instance object.");
+    py_cls.def("commit", &pl::commit, "Commits the instance object.");
 }
 
+void bind_inst_group(py::module &m) {
+    auto py_cls = py::class_<pl::inst_group>(m, "PyLayInstGroup");
+    py_cls.doc() = "A group of uncommitted layout instances that are edited together.";
+    py_cls.def(py::init<std::vector<pl::inst_ref>>(), "Create a new group of instances.",
+               py::arg("refs"));
+    py_cls.def("__len__", &pl::inst_group::size, "Returns the number of instances.");
+    py_cls.def("move_by",
+               py::overload_cast<cbag::offset_t, cbag::offset_t>(&pl::inst_group::move_by),
+               "Moves all instances.", py::arg("dx"), py::arg("dy"));
+    py_cls.def("move_by", py::overload_cast<const pu::py_coord_array &>(&pl::inst_group::move_by),
+               "Moves each instance by the corresponding [dx, dy] row of the given (N, 2) array.",
+               py::arg("offsets"));
+    py_cls.def("transform", &pl::inst_group::transform, "Transforms all instances.",
+               py::arg("xform"));
+    py_cls.def("set_xforms", &pl::inst_group::set_xforms,
+               "Sets the transformation of each instance to the corresponding "
+               "[dx, dy, orient_code] row of the given (N, 3) array.",
+               py::arg("xforms"));
+    py_cls.def("set_master", &pl::inst_group::set_master,
+               "Sets the master of all instances.", py::keep_alive<1, 2>(),
+               py::arg("new_master"));
+}
+
+/** Binds PyLayCellView.
+ *
+ *  Thread safety: cbag cellviews are not synchronized.  The bulk add methods (add_rects, add_warrs,
+ *  add_vias_on_intersections, add_instances and the array forms of add_poly, add_path,
+ *  add_blockage and add_boundary) and the queries (the intersect queries, flatten and the
+ *  hierarchical query) release the GIL while cbag runs.  Python code must not call any method on
+ *  a cellview, or on a master of its instances, from another thread while one of these is in
+ *  progress, unless both calls are queries.  Queries only read, so any number of them may run
+ *  concurrently.  Fill keeps the GIL, since it reads and writes the same cellview.
+ */
 void bind_cellview(py::class_<c_cellview, std::shared_ptr<c_cellview>> &py_cls, py::module &m) {
     using c_tid = cbag::layout::track_id;
     using tup_int = pyg::Tuple<py::int_, py::int_>;
 
-    py_cls.doc() = "A layout cellview.";
+    py_cls.doc() = "A layout cellview.  Not thread-safe: methods that release the GIL must not "
+                   "run concurrently with other methods on the same cellview, except other "
+                   "queries.";
 
-    py_cls.def(py::init<std::shared_ptr<const cbag::layout::routing_grid>,
-                        std::shared_ptr<const cbag::layout::track_coloring>, std::string>(),
+    py_cls.def(py::init([](std::shared_ptr<const cbag::layout::routing_grid> grid,
+                           std::shared_ptr<const cbag::layout::track_coloring> tr_colors,
+                           std::string cell_name) {
+                   auto ans = pl::make_tracked(std::move(grid), std::move(tr_colors),
+                                               std::move(cell_name));
+                   pl::track_content_hash(ans);
+                   return ans;
+               }),
                "Construct a new cellview.", py::keep_alive<1, 2>(), py::keep_alive<1, 3>(),
                py::arg("grid"), py::arg("tr_colors"), py::arg("cell_name"));
     py_cls.def_property_readonly("is_empty", &c_cellview::empty, "True if this cellview is empty.");
     py_cls.def_property_readonly("cell_name", &c_cellview::get_name, "The cell name.");
+    py_cls.def_property_readonly(
+        "content_hash",
+        [](const std::shared_ptr<c_cellview> &cv_ptr) {
+            return pl::get_content_hash(cv_ptr);
+        },
+        "A hash of the content of this cellview, independent of the order objects are added in.  "
+        "It covers the routing grid and track coloring, but wires are hashed by TrackID and "
+        "coordinates and instances by the hash of their master when added, so equal hashes are "
+        "only a hint; use == to confirm.  Cellviews changed by polygons, paths, blockages, "
+        "boundaries, uncommitted shapes or vias, via/track connections or fill, or not created "
+        "by this constructor or clone(), get a hash unique to themselves while they live.");
 
     py_cls.def("__eq__", &c_cellview::operator==,
                "Returns True if the two layout cellviews are equal.", py::arg("other"));
-    py_cls.def("set_grid", &c_cellview::set_grid, "Sets the routing grid.", py::arg("grid"));
+    py_cls.def("clone", &pl::clone,
+               "Returns a deep copy of this cellview.  The copy keeps the masters of its "
+               "instances alive, but not this cellview.  Raises RuntimeError if the copy would "
+               "share geometry with this cellview.");
+    py_cls.def("set_grid",
+               [](const std::shared_ptr<c_cellview> &cv_ptr,
+                  std::shared_ptr<const cbag::layout::routing_grid> grid) {
+                   pl::invalidate_content_hash(cv_ptr);
+                   cv_ptr->set_grid(std::move(grid));
+               },
+               "Sets the routing grid.", py::arg("grid"));
     py_cls.def("get_rect_bbox", &cbag::layout::get_bbox,
                "Get the overall bounding box on the given layer.", py::arg("layer"),
                py::arg("purpose"));
-    py_cls.def("add_prim_instance", &cbag::layout::add_prim_instance, "Adds a primitive instance.",
-               py::arg("lib"), py::arg("cell"), py::arg("view"), py::arg("name"), py::arg("xform"),
-               py::arg("nx"), py::arg("ny"), py::arg("spx"), py::arg("spy"), py::arg("commit"));
-    py_cls.def("add_instance", &cbag::layout::add_instance, "Adds an instance",
-               py::keep_alive<1, 2>(), py::arg("cv"), py::arg("name"), py::arg("xform"),
-               py::arg("nx"), py::arg("ny"), py::arg("spx"), py::arg("spy"), py::arg("commit"));
-    py_cls.def("add_rect", &cbag::layout::add_rect, "Adds a rectangle.", py::arg("layer"),
-               py::arg("purpose"), py::arg("bbox"), py::arg("commit"));
+    py_cls.def("add_prim_instance", &pl::add_prim_instance, "Adds a primitive instance.",
+               py::arg("lib"), py::arg("cell"), py::arg("view"), py::arg("name"),
+               py::arg("xform"), py::arg("nx"), py::arg("ny"), py::arg("spx"), py::arg("spy"),
+               py::arg("commit"));
+    py_cls.def("add_instance", &pl::add_instance, "Adds an instance", py::keep_alive<1, 2>(),
+               py::arg("cv"), py::arg("name"), py::arg("xform"), py::arg("nx"), py::arg("ny"),
+               py::arg("spx"), py::arg("spy"), py::arg("commit"));
+    py_cls.def("add_instances", &pl::add_instances,
+               "Adds an instance of the given master for each name, with the transformations in "
+               "the given (N, 3) array of [dx, dy, orient_code] rows.  Returns the list of "
+               "instance references if return_refs is True, otherwise None.  commit=False "
+               "requires return_refs=True.",
+               py::keep_alive<1, 2>(), py::arg("cv"), py::arg("names"), py::arg("xforms"),
+               py::arg("nx") = 1, py::arg("ny") = 1, py::arg("spx") = 0, py::arg("spy") = 0,
+               py::arg("commit") = true, py::arg("return_refs") = false);
+    py_cls.def("add_rect",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const cbag::box_t &bbox, bool commit) {
+                   return pl::add_rect(cv_ptr, pl::get_layer_t(*cv_ptr, layer, purpose), bbox,
+                                       commit);
+               },
+               "Adds a rectangle.", py::arg("layer"), py::arg("purpose"), py::arg("bbox"),
+               py::arg("commit"));
+    py_cls.def("add_rect",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, pu::py_layer_key key,
+                  const cbag::box_t &bbox, bool commit) {
+                   return pl::add_rect(cv_ptr, pu::from_layer_key(key), bbox, commit);
+               },
+               "Adds a rectangle.", py::arg("layer_key"), py::arg("bbox"), py::arg("commit"));
     py_cls.def("add_rect_arr",
-               [](c_cellview &cv, const std::string &layer, const std::string &purpose,
-                  const cbag::box_t &box, cbag::cnt_t nx, cbag::cnt_t ny, cbag::offset_t spx,
-                  cbag::offset_t spy) {
-                   auto key = cbag::layout::layer_t_at(*(cv.get_tech()), layer, purpose);
-                   cv.add_shape(key, c_box_arr{box, std::array<cbag::cnt_t, 2>{nx, ny},
-                                               std::array<cbag::offset_t, 2>{spx, spy}});
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const cbag::box_t &box, cbag::cnt_t nx,
+                  cbag::cnt_t ny, cbag::offset_t spx, cbag::offset_t spy) {
+                   pl::add_shape(cv_ptr, pl::get_layer_t(*cv_ptr, layer, purpose),
+                                 c_box_arr{box, std::array<cbag::cnt_t, 2>{nx, ny},
+                                           std::array<cbag::offset_t, 2>{spx, spy}});
                },
                "Adds an array of rectangles.", py::arg("layer"), py::arg("purpose"), py::arg("box"),
                py::arg("nx"), py::arg("ny"), py::arg("spx"), py::arg("spy"));
     py_cls.def("add_rect_arr",
-               [](c_cellview &cv, const std::string &layer, const std::string &purpose,
-                  const c_box_arr &barr) {
-                   auto key = cbag::layout::layer_t_at(*(cv.get_tech()), layer, purpose);
-                   cv.add_shape(key, barr);
+               [](const std::shared_ptr<c_cellview> &cv_ptr, pu::py_layer_key key,
+                  const cbag::box_t &box, cbag::cnt_t nx, cbag::cnt_t ny, cbag::offset_t spx,
+                  cbag::offset_t spy) {
+                   pl::add_shape(cv_ptr, pu::from_layer_key(key),
+                                 c_box_arr{box, std::array<cbag::cnt_t, 2>{nx, ny},
+                                           std::array<cbag::offset_t, 2>{spx, spy}});
+               },
+               "Adds an array of rectangles.", py::arg("layer_key"), py::arg("box"), py::arg("nx"),
+               py::arg("ny"), py::arg("spx"), py::arg("spy"));
+    py_cls.def("add_rect_arr",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const c_box_arr &barr) {
+                   pl::add_shape(cv_ptr, pl::get_layer_t(*cv_ptr, layer, purpose), barr);
                },
                "Adds an array of rectangles.", py::arg("layer"), py::arg("purpose"),
                py::arg("barr"));
+    py_cls.def("add_rect_arr",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, pu::py_layer_key key,
+                  const c_box_arr &barr) {
+                   pl::add_shape(cv_ptr, pu::from_layer_key(key), barr);
+               },
+               "Adds an array of rectangles.", py::arg("layer_key"), py::arg("barr"));
     py_cls.def("add_rect_list",
-               [](c_cellview &cv, const std::string &layer, const std::string &purpose,
-                  const cbag::box_collection &bcol) {
-                   auto key = cbag::layout::layer_t_at(*(cv.get_tech()), layer, purpose);
-                   cv.add_shape(key, bcol);
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const cbag::box_collection &bcol) {
+                   pl::add_shape(cv_ptr, pl::get_layer_t(*cv_ptr, layer, purpose), bcol);
                },
                "Adds a list of rectangles.", py::arg("layer"), py::arg("purpose"), py::arg("bcol"));
+    py_cls.def("add_rect_list",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, pu::py_layer_key key,
+                  const cbag::box_collection &bcol) {
+                   pl::add_shape(cv_ptr, pu::from_layer_key(key), bcol);
+               },
+               "Adds a list of rectangles.", py::arg("layer_key"), py::arg("bcol"));
+    py_cls.def("add_rects",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const pu::py_coord_array &boxes) {
+                   auto *data = boxes.data();
+                   pl::add_rects(cv_ptr, pl::get_layer_t(*cv_ptr, layer, purpose),
+                                 pu::num_boxes(boxes),
+                                 [data](std::size_t idx) { return pu::get_box(data, idx); });
+               },
+               "Adds all rectangles in the given (N, 4) array of [xl, yl, xh, yh] rows.",
+               py::arg("layer"), py::arg("purpose"), py::arg("boxes"));
+    py_cls.def("add_rects",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, pu::py_layer_key key,
+                  const pu::py_coord_array &boxes) {
+                   auto *data = boxes.data();
+                   pl::add_rects(cv_ptr, pu::from_layer_key(key), pu::num_boxes(boxes),
+                                 [data](std::size_t idx) { return pu::get_box(data, idx); });
+               },
+               "Adds all rectangles in the given (N, 4) array of [xl, yl, xh, yh] rows.",
+               py::arg("layer_key"), py::arg("boxes"));
+    py_cls.def("add_rects",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const c_box_batch &boxes) {
+                   pl::add_rects(cv_ptr, pl::get_layer_t(*cv_ptr, layer, purpose), boxes.size(),
+                                 [&boxes](std::size_t idx) { return boxes.get_box(idx); });
+               },
+               "Adds all rectangles in the given BBoxBatch.", py::arg("layer"), py::arg("purpose"),
+               py::arg("boxes"));
+    py_cls.def("add_rects",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, pu::py_layer_key key,
+                  const c_box_batch &boxes) {
+                   pl::add_rects(cv_ptr, pu::from_layer_key(key), boxes.size(),
+                                 [&boxes](std::size_t idx) { return boxes.get_box(idx); });
+               },
+               "Adds all rectangles in the given BBoxBatch.", py::arg("layer_key"),
+               py::arg("boxes"));
 
-    py_cls.def("add_warr", &c_cellview::add_warr, "Adds a WireArray.", py::arg("tid"),
+    py_cls.def("add_warr",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const c_tid &tid,
+                  cbag::coord_t lower, cbag::coord_t upper, bool is_dummy) {
+                   cv_ptr->add_warr(tid, lower, upper, is_dummy);
+                   pl::add_content_hash(cv_ptr, pl::hash_warr(tid, lower, upper, is_dummy));
+               },
+               "Adds a WireArray.", py::arg("tid"),
                py::arg("lower"), py::arg("upper"), py::arg("is_dummy") = false);
-    py_cls.def("add_poly", &cbag::layout::add_poly<py_pt_vector>, "Adds a new polygon.",
-               py::arg("layer"), py::arg("purpose"), py::arg("points"), py::arg("commit"));
+    py_cls.def("add_warrs", &pl::add_warrs,
+               "Adds a WireArray for each of the given TrackIDs, with the given lower and upper "
+               "coordinate arrays.  Wires with the same TrackID and length share one grid lookup, "
+               "and the rectangles are added to each layer in one call.",
+               py::arg("tids"), py::arg("lowers"), py::arg("uppers"), py::arg("is_dummy") = false);
+    py_cls.def("add_poly", pl::untracked(&cbag::layout::add_poly<py_pt_vector>),
+               "Adds a new polygon.", py::arg("layer"), py::arg("purpose"), py::arg("points"),
+               py::arg("commit"));
+    py_cls.def("add_poly",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const pu::py_coord_array &points, bool commit) {
+                   auto data = py_pt_array(points);
+                   py::gil_scoped_release release;
+                   pl::invalidate_content_hash(cv_ptr);
+                   return cbag::layout::add_poly(cv_ptr, layer, purpose, data, commit);
+               },
+               "Adds a new polygon from a (N, 2) array of points.", py::arg("layer"),
+               py::arg("purpose"), py::arg("points"), py::arg("commit"));
     py_cls.def("add_blockage",
                [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
                   cbag::enum_t blk_code, const py_pt_vector &data, bool commit) {
+                   pl::invalidate_content_hash(cv_ptr);
                    return cbag::layout::add_blockage(
                        cv_ptr, layer, static_cast<cbag::blockage_type>(blk_code), data, commit);
                },
                "Adds a blockage object.", py::arg("layer"), py::arg("blk_code"), py::arg("points"),
                py::arg("commit"));
+    py_cls.def("add_blockage",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  cbag::enum_t blk_code, const pu::py_coord_array &points, bool commit) {
+                   auto data = py_pt_array(points);
+                   py::gil_scoped_release release;
+                   pl::invalidate_content_hash(cv_ptr);
+                   return cbag::layout::add_blockage(
+                       cv_ptr, layer, static_cast<cbag::blockage_type>(blk_code), data, commit);
+               },
+               "Adds a blockage object from a (N, 2) array of points.", py::arg("layer"),
+               py::arg("blk_code"), py::arg("points"), py::arg("commit"));
     py_cls.def("add_boundary",
                [](const std::shared_ptr<c_cellview> &cv_ptr, cbag::enum_t bnd_code,
                   const py_pt_vector &data, bool commit) {
+                   pl::invalidate_content_hash(cv_ptr);
                    return cbag::layout::add_boundary(
                        cv_ptr, static_cast<cbag::boundary_type>(bnd_code), data, commit);
                },
                "Adds a boundary object.", py::arg("bnd_code"), py::arg("points"),
                py::arg("commit"));
-    py_cls.def("add_pin", &cbag::layout::add_pin, "Adds a pin object.", py::arg("layer"),
-               py::arg("net"), py::arg("label"), py::arg("bbox"));
-    py_cls.def("add_pin_arr", &cbag::layout::add_pin_arr, "Adds an arry of pins.", py::arg("net"),
-               py::arg("label"), py::arg("tid"), py::arg("lower"), py::arg("upper"));
-    py_cls.def("add_label", &cbag::layout::add_label, "Adds a label object.", py::arg("layer"),
-               py::arg("purpose"), py::arg("xform"), py::arg("label"), py::arg("height"));
+    py_cls.def("add_boundary",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, cbag::enum_t bnd_code,
+                  const pu::py_coord_array &points, bool commit) {
+                   auto data = py_pt_array(points);
+                   py::gil_scoped_release release;
+                   pl::invalidate_content_hash(cv_ptr);
+                   return cbag::layout::add_boundary(
+                       cv_ptr, static_cast<cbag::boundary_type>(bnd_code), data, commit);
+               },
+               "Adds a boundary object from a (N, 2) array of points.", py::arg("bnd_code"),
+               py::arg("points"), py::arg("commit"));
+    py_cls.def("add_pin",
+               pl::hashed(&cbag::layout::add_pin,
+                          [](const c_cellview &, const auto &layer, const auto &net,
+                             const auto &label, const cbag::box_t &bbox) {
+                              return std::optional<std::uint64_t>(pl::hash_of(
+                                  pl::hash_tag::pin, pl::hash_str(layer), pl::hash_str(net),
+                                  pl::hash_str(label), xl(bbox), yl(bbox), xh(bbox), yh(bbox)));
+                          }),
+               "Adds a pin object.", py::arg("layer"), py::arg("net"), py::arg("label"),
+               py::arg("bbox"));
+    py_cls.def("add_pin_arr", pl::untracked(&cbag::layout::add_pin_arr), "Adds an arry of pins.",
+               py::arg("net"), py::arg("label"), py::arg("tid"), py::arg("lower"),
+               py::arg("upper"));
+    py_cls.def("add_label",
+               pl::hashed(&cbag::layout::add_label,
+                          [](const c_cellview &, const auto &layer, const auto &purpose,
+                             const auto &xform, const auto &label, auto height) {
+                              return std::optional<std::uint64_t>(pl::hash_of(
+                                  pl::hash_tag::label, pl::hash_str(layer), pl::hash_str(purpose),
+                                  pl::hash_xform(xform), pl::hash_str(label), height));
+                          }),
+               "Adds a label object.", py::arg("layer"), py::arg("purpose"), py::arg("xform"),
+               py::arg("label"), py::arg("height"));
     py_cls.def("add_path",
                [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
                   const std::string &purpose, const py_pt_vector &data, cbag::offset_t half_width,
                   cbag::enum_t style0, cbag::enum_t style1, cbag::enum_t stylem, bool commit) {
+                   pl::invalidate_content_hash(cv_ptr);
                    return add_path(cv_ptr, layer, purpose, data, half_width,
                                    static_cast<cbag::end_style>(style0),
                                    static_cast<cbag::end_style>(style1),
@@ -242,11 +1657,28 @@ void bind_cellview(py::class_<c_cellview, std::shared_ptr<c_cellview>> &py_cls,
                "Adds a new path.", py::arg("layer"), py::arg("purpose"), py::arg("points"),
                py::arg("half_width"), py::arg("style0"), py::arg("style1"), py::arg("stylem"),
                py::arg("commit"));
+    py_cls.def("add_path",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const pu::py_coord_array &points,
+                  cbag::offset_t half_width, cbag::enum_t style0, cbag::enum_t style1,
+                  cbag::enum_t stylem, bool commit) {
+                   auto data = py_pt_array(points);
+                   py::gil_scoped_release release;
+                   pl::invalidate_content_hash(cv_ptr);
+                   return add_path(cv_ptr, layer, purpose, data, half_width,
+                                   static_cast<cbag::end_style>(style0),
+                                   static_cast<cbag::end_style>(style1),
+                                   static_cast<cbag::end_style>(stylem), commit);
+               },
+               "Adds a new path from a (N, 2) array of points.", py::arg("layer"),
+               py::arg("purpose"), py::arg("points"), py::arg("half_width"), py::arg("style0"),
+               py::arg("style1"), py::arg("stylem"), py::arg("commit"));
     py_cls.def("add_path45_bus",
                [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
                   const std::string &purpose, const py_pt_vector &data, pyg::List<int> widths,
                   pyg::List<int> spaces, cbag::enum_t style0, cbag::enum_t style1,
                   cbag::enum_t stylem, bool commit) {
+                   pl::invalidate_content_hash(cv_ptr);
                    return add_path45_bus(cv_ptr, layer, purpose, data, widths, spaces,
                                          static_cast<cbag::end_style>(style0),
                                          static_cast<cbag::end_style>(style1),
@@ -255,24 +1687,52 @@ void bind_cellview(py::class_<c_cellview, std::shared_ptr<c_cellview>> &py_cls,
                "Adds a new 45 degree path bus.", py::arg("layer"), py::arg("purpose"),
                py::arg("points"), py::arg("widths"), py::arg("spaces"), py::arg("style0"),
                py::arg("style1"), py::arg("stylem"), py::arg("commit"));
-    py_cls.def("add_via", &cbag::layout::add_via, "Add a via.", py::arg("xform"), py::arg("via_id"),
+    py_cls.def("add_path45_bus",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const std::string &layer,
+                  const std::string &purpose, const pu::py_coord_array &points,
+                  pyg::List<int> widths, pyg::List<int> spaces, cbag::enum_t style0,
+                  cbag::enum_t style1, cbag::enum_t stylem, bool commit) {
+                   pl::invalidate_content_hash(cv_ptr);
+                   return add_path45_bus(cv_ptr, layer, purpose, py_pt_array(points), widths,
+                                         spaces, static_cast<cbag::end_style>(style0),
+                                         static_cast<cbag::end_style>(style1),
+                                         static_cast<cbag::end_style>(stylem), commit);
+               },
+               "Adds a new 45 degree path bus from a (N, 2) array of points.", py::arg("layer"),
+               py::arg("purpose"), py::arg("points"), py::arg("widths"), py::arg("spaces"),
+               py::arg("style0"), py::arg("style1"), py::arg("stylem"), py::arg("commit"));
+    py_cls.def("add_via",
+               pl::hashed(&cbag::layout::add_via,
+                          [](const c_cellview &, const cbag::transformation &xform,
+                             const std::string &via_id, const cbag::layout::via_param &params,
+                             bool add_layers, bool commit) {
+                              return commit ? std::optional<std::uint64_t>(pl::hash_via(
+                                                  xform, via_id, params, add_layers, 1, 1, 0, 0))
+                                            : std::nullopt;
+                          }),
+               "Add a via.", py::arg("xform"), py::arg("via_id"),
                py::arg("params"), py::arg("add_layers"), py::arg("commit"));
     py_cls.def(
         "add_via_arr",
-        [](c_cellview &cv, const cbag::transformation &xform, const std::string &via_id,
-           const cbag::layout::via_param &params, bool add_layers, cbag::cnt_t nx, cbag::cnt_t ny,
-           cbag::offset_t spx, cbag::offset_t spy) {
-            cbag::layout::add_via_arr(cv, xform, via_id, params, add_layers, {nx, ny}, {spx, spy});
+        [](const std::shared_ptr<c_cellview> &cv_ptr, const cbag::transformation &xform,
+           const std::string &via_id, const cbag::layout::via_param &params, bool add_layers,
+           cbag::cnt_t nx, cbag::cnt_t ny, cbag::offset_t spx, cbag::offset_t spy) {
+            cbag::layout::add_via_arr(*cv_ptr, xform, via_id, params, add_layers, {nx, ny},
+                                      {spx, spy});
+            pl::add_content_hash(
+                cv_ptr, pl::hash_via(xform, via_id, params, add_layers, nx, ny, spx, spy));
         },
         "Add an array of vias.", py::arg("xform"), py::arg("via_id"), py::arg("params"),
         py::arg("add_layers"), py::arg("nx"), py::arg("ny"), py::arg("spx"), py::arg("spy"));
     py_cls.def("add_via_on_intersections",
-               [](c_cellview &cv, const c_tid &tid1, const c_tid &tid2, cbag::coord_t l1,
-                  cbag::coord_t u1, cbag::coord_t l2, cbag::coord_t u2, bool extend, bool contain) {
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const c_tid &tid1, const c_tid &tid2,
+                  cbag::coord_t l1, cbag::coord_t u1, cbag::coord_t l2, cbag::coord_t u2,
+                  bool extend, bool contain) {
+                   pl::invalidate_content_hash(cv_ptr);
                    auto coord1 = std::array<cbag::coord_t, 2>{l1, u1};
                    auto coord2 = std::array<cbag::coord_t, 2>{l2, u2};
-                   auto tmp = cbag::layout::add_via_on_intersections(cv, tid1, tid2, coord1, coord2,
-                                                                     extend, contain);
+                   auto tmp = cbag::layout::add_via_on_intersections(*cv_ptr, tid1, tid2, coord1,
+                                                                     coord2, extend, contain);
                    return pyg::Tuple<tup_int, tup_int>::make_tuple(
                        tup_int::make_tuple(tmp[0][0], tmp[0][1]),
                        tup_int::make_tuple(tmp[1][0], tmp[1][1]));
@@ -280,18 +1740,22 @@ void bind_cellview(py::class_<c_cellview, std::shared_ptr<c_cellview>> &py_cls,
                "Add vias on the wire intersections.", py::arg("tid1"), py::arg("tid2"),
                py::arg("l1"), py::arg("u1"), py::arg("l2"), py::arg("u2"), py::arg("extend"),
                py::arg("contain"));
+    py_cls.def("add_vias_on_intersections", &pl::add_vias_on_intersections,
+               "Add vias on all intersections between two sets of wires.  Returns a (N1, N2, 2, 2) "
+               "array of the add_via_on_intersections() results for each pair of wires.  Pairs "
+               "of wires that cannot touch are skipped and return their input coordinates.",
+               py::arg("tids1"), py::arg("tids2"), py::arg("lowers1"), py::arg("uppers1"),
+               py::arg("lowers2"), py::arg("uppers2"), py::arg("extend"), py::arg("contain"));
     py_cls.def("connect_barr_to_tracks",
-               [](c_cellview &cv, cbag::enum_t lev_code, const std::string &layer,
-                  const std::string &purpose, const c_box_arr &barr,
+               [](const std::shared_ptr<c_cellview> &cv_ptr, cbag::enum_t lev_code,
+                  const std::string &layer, const std::string &purpose, const c_box_arr &barr,
                   const cbag::layout::track_id &tid, std::optional<cbag::coord_t> tr_lower,
                   std::optional<cbag::coord_t> tr_upper, int min_len_code,
                   std::optional<cbag::coord_t> w_lower, std::optional<cbag::coord_t> w_upper) {
-                   auto vdir = static_cast<cbag::direction_1d>(lev_code);
-                   auto mode = static_cast<cbag::min_len_mode>(min_len_code);
-                   auto key = cbag::layout::layer_t_at(*(cv.get_tech()), layer, purpose);
-                   auto tmp = cbag::layout::connect_box_track(cv, vdir, key, barr.base, barr.num,
-                                                              barr.sp, tid, {w_lower, w_upper},
-                                                              {tr_lower, tr_upper}, mode);
+                   pl::invalidate_content_hash(cv_ptr);
+                   auto tmp = pl::connect_barr_to_tracks(
+                       *cv_ptr, lev_code, pl::get_layer_t(*cv_ptr, layer, purpose), barr, tid,
+                       tr_lower, tr_upper, min_len_code, w_lower, w_upper);
                    return pyg::Tuple<tup_int, tup_int>::make_tuple(
                        tup_int::make_tuple(tmp[0][0], tmp[0][1]),
                        tup_int::make_tuple(tmp[1][0], tmp[1][1]));
@@ -300,10 +1764,29 @@ void bind_cellview(py::class_<c_cellview, std::shared_ptr<c_cellview>> &py_cls,
                py::arg("purpose"), py::arg("barr"), py::arg("tid"), py::arg("tr_lower"),
                py::arg("tr_upper"), py::arg("min_len_code"), py::arg("w_lower"),
                py::arg("w_upper"));
+    py_cls.def("connect_barr_to_tracks",
+               [](const std::shared_ptr<c_cellview> &cv_ptr, cbag::enum_t lev_code,
+                  pu::py_layer_key key, const c_box_arr &barr, const cbag::layout::track_id &tid,
+                  std::optional<cbag::coord_t> tr_lower, std::optional<cbag::coord_t> tr_upper,
+                  int min_len_code, std::optional<cbag::coord_t> w_lower,
+                  std::optional<cbag::coord_t> w_upper) {
+                   pl::invalidate_content_hash(cv_ptr);
+                   auto tmp = pl::connect_barr_to_tracks(*cv_ptr, lev_code, pu::from_layer_key(key),
+                                                         barr, tid, tr_lower, tr_upper,
+                                                         min_len_code, w_lower, w_upper);
+                   return pyg::Tuple<tup_int, tup_int>::make_tuple(
+                       tup_int::make_tuple(tmp[0][0], tmp[0][1]),
+                       tup_int::make_tuple(tmp[1][0], tmp[1][1]));
+               },
+               "Connect the given BBoxArray to tracks.", py::arg("lev_code"), py::arg("layer_key"),
+               py::arg("barr"), py::arg("tid"), py::arg("tr_lower"), py::arg("tr_upper"),
+               py::arg("min_len_code"), py::arg("w_lower"), py::arg("w_upper"));
     py_cls.def("connect_warr_to_tracks",
-               [](c_cellview &cv, const c_tid &w_tid, const c_tid &tid, cbag::coord_t w_lower,
-                  cbag::coord_t w_upper) {
-                   auto tmp = cbag::layout::connect_warr_track(cv, w_tid, tid, w_lower, w_upper);
+               [](const std::shared_ptr<c_cellview> &cv_ptr, const c_tid &w_tid, const c_tid &tid,
+                  cbag::coord_t w_lower, cbag::coord_t w_upper) {
+                   pl::invalidate_content_hash(cv_ptr);
+                   auto tmp =
+                       cbag::layout::connect_warr_track(*cv_ptr, w_tid, tid, w_lower, w_upper);
                    return pyg::Tuple<tup_int, tup_int>::make_tuple(
                        tup_int::make_tuple(tmp[0][0], tmp[0][1]),
                        tup_int::make_tuple(tmp[1][0], tmp[1][1]));
@@ -311,9 +1794,11 @@ void bind_cellview(py::class_<c_cellview, std::shared_ptr<c_cellview>> &py_cls,
                "Connect the given WireArray to tracks.", py::arg("w_tid"), py::arg("tid"),
                py::arg("w_lower"), py::arg("w_upper"));
     py_cls.def("do_max_space_fill",
-               [](c_cellview &cv, cbag::level_t level, const cbag::box_t &bbox, bool fill_bndry,
+               [](const std::shared_ptr<c_cellview> &cv_ptr, cbag::level_t level,
+                  const cbag::box_t &bbox, bool fill_bndry,
                   pyg::Tuple<int, int, int, int, double> fill_info) {
-                   cv.do_max_space_fill(
+                   pl::invalidate_content_hash(cv_ptr);
+                   cv_ptr->do_max_space_fill(
                        level, bbox, fill_bndry,
                        std::array<cbag::offset_t, 2>{fill_info.get<0>(), fill_info.get<1>()},
                        std::array<cbag::offset_t, 2>{fill_info.get<2>(), fill_info.get<3>()},
@@ -321,16 +1806,47 @@ void bind_cellview(py::class_<c_cellview, std::shared_ptr<c_cellview>> &py_cls,
                },
                "Perform max space fill on the given layer.", py::arg("level"), py::arg("bbox"),
                py::arg("fill_boundary"), py::arg("fill_info"));
+    py_cls.def("flatten", &pl::flatten,
+               "Flattens the hierarchy of this cellview.  Returns a dictionary from each given "
+               "level to a (N, 4) array of the bounding boxes of all geometry on that level.  Only "
+               "committed instances added with add_instance() are flattened.",
+               py::arg("levels"), py::arg("num_threads") = 0);
     py_cls.def("get_intersect", pybag::lay::get_intersect,
                "Get a list of bound boxes of all geometry intersecting the given box.",
                py::arg("layer"), py::arg("bnd_box"), py::arg("spx"), py::arg("spy"),
                py::arg("no_sp"));
+    py_cls.def("get_intersect_array", &pl::get_intersect_array,
+               "Get a (N, 4) array of bound boxes of all geometry intersecting the given box.",
+               py::arg("layer"), py::arg("bnd_box"), py::arg("spx"), py::arg("spy"),
+               py::arg("no_sp"));
+    py_cls.def("count_intersect", &pl::count_intersect,
+               "Returns the number of geometry intersecting the given box.", py::arg("layer"),
+               py::arg("bnd_box"), py::arg("spx"), py::arg("spy"), py::arg("no_sp"));
+    py_cls.def("has_intersect", &pl::has_intersect,
+               "Returns True if any geometry intersects the given box.  Stops at the first hit.",
+               py::arg("layer"), py::arg("bnd_box"), py::arg("spx"), py::arg("spy"),
+               py::arg("no_sp"));
+    py_cls.def("get_intersect_hier", &pl::get_intersect_hier,
+               "Get the geometry intersecting the given box in this cellview and all instances "
+               "added with add_instance().  Returns the tuple (boxes, xforms), where boxes is a "
+               "(N, 4) array of bound boxes in this cellview, and xforms is a (N, 3) array of "
+               "[dx, dy, orient_code] rows of the transformation of the instance containing each "
+               "box.",
+               py::arg("layer"), py::arg("bnd_box"), py::arg("spx"), py::arg("spy"),
+               py::arg("no_sp"));
+    py_cls.def("get_intersect_batch", &pl::get_intersect_batch,
+               "Queries the geometry intersecting each of the given (N, 4) boxes.  Returns the "
+               "tuple (offsets, boxes), where the results of the i-th box are "
+               "boxes[offsets[i]:offsets[i + 1]].",
+               py::arg("layer"), py::arg("bnd_boxes"), py::arg("spx"), py::arg("spy"),
+               py::arg("no_sp"));
 }
 
 void bind_layout(py::module &m) {
     auto cv_cls = py::class_<c_cellview, std::shared_ptr<c_cellview>>(m, "PyLayCellView");
 
     bind_inst_ref(m);
+    bind_inst_group(m);
     bind_cellview(cv_cls, m);
 
     m.attr("COORD_MIN") = std::numeric_limits<cbag::coord_t>::min();
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+Copyright 2020 Blue Cheetah Analog Design Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef PYBAG_NUMPY_UTIL_H
+#define PYBAG_NUMPY_UTIL_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+
+#include <cbag/common/box_t.h>
+
+#include <pybag/typedefs.h>
+
+namespace py = pybind11;
+
+namespace pybag {
+namespace util {
+
+using py_id_t = std::int64_t;
+
+using py_coord_array = py::array_t<coord_t, py::array::c_style | py::array::forcecast>;
+using py_id_array = py::array_t<py_id_t, py::array::c_style | py::array::forcecast>;
+
+// moves the given vector into a 1D NumPy array without copying.
+template <class T> py::array_t<T> to_numpy(std::vector<T> &&vec) {
+    auto *ptr = new std::vector<T>(std::move(vec));
+    auto owner = py::capsule(ptr, [](void *p) { delete reinterpret_cast<std::vector<T> *>(p); });
+    return py::array_t<T>(ptr->size(), ptr->data(), owner);
+}
+
+/** Results of a batch of queries in compressed sparse row (CSR) form.
+ *
+ *  The results of the i-th query are ids[offsets[i]:offsets[i + 1]].
+ */
+struct csr_ids {
+    std::vector<py_id_t> offsets;
+    std::vector<py_id_t> ids;
+
+    csr_ids() = default;
+
+    explicit csr_ids(std::size_t num_queries) {
+        offsets.reserve(num_queries + 1);
+        offsets.push_back(0);
+    }
+
+    void end_row() { offsets.push_back(static_cast<py_id_t>(ids.size())); }
+
+    // appends all rows of other after the rows of this object.
+    void extend(const csr_ids &other) {
+        auto shift = static_cast<py_id_t>(ids.size());
+        ids.insert(ids.end(), other.ids.begin(), other.ids.end());
+        for (auto iter = other.offsets.begin() + 1; iter != other.offsets.end(); ++iter) {
+            offsets.push_back(*iter + shift);
+        }
+    }
+};
+
+inline std::pair<py::array_t<py_id_t>, py::array_t<py_id_t>> to_numpy(csr_ids &&val) {
+    return {to_numpy(std::move(val.offsets)), to_numpy(std::move(val.ids))};
+}
+
+// returns the given boxes as a (N, 4) NumPy array of [xl, yl, xh, yh] rows.
+inline py::array_t<coord_t> boxes_to_numpy(const std::vector<cbag::box_t> &boxes) {
+    auto n = static_cast<py::ssize_t>(boxes.size());
+    auto ans = py::array_t<coord_t>({n, static_cast<py::ssize_t>(4)});
+    auto *ptr = ans.mutable_data();
+    for (const auto &box : boxes) {
+        ptr[0] = xl(box);
+        ptr[1] = yl(box);
+        ptr[2] = xh(box);
+        ptr[3] = yh(box);
+        ptr += 4;
+    }
+    return ans;
+}
+
+// returns the number of boxes in the given (N, 4) NumPy array.
+inline std::size_t num_boxes(const py_coord_array &arr) {
+    if (arr.ndim() != 2 || arr.shape(1) != 4)
+        throw std::invalid_argument(
+            fmt::format("box array must have shape (N, 4), got ndim = {}.", arr.ndim()));
+    return static_cast<std::size_t>(arr.shape(0));
+}
+
+// returns the number of points in the given (N, 2) NumPy array.
+inline std::size_t num_points(const py_coord_array &arr) {
+    if (arr.ndim() != 2 || arr.shape(1) != 2)
+        throw std::invalid_argument(
+            fmt::format("point array must have shape (N, 2), got ndim = {}.", arr.ndim()));
+    return static_cast<std::size_t>(arr.shape(0));
+}
+
+// returns the idx-th box of the given (N, 4) NumPy array.
+inline cbag::box_t get_box(const coord_t *data, std::size_t idx) {
+    auto *ptr = data + 4 * idx;
+    return cbag::box_t{ptr[0], ptr[1], ptr[2], ptr[3]};
+}
+
+inline std::vector<cbag::box_t> boxes_from_numpy(const py_coord_array &arr) {
+    auto n = num_boxes(arr);
+    auto *data = arr.data();
+    auto ans = std::vector<cbag::box_t>();
+    ans.reserve(n);
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        ans.push_back(get_box(data, idx));
+    }
+    return ans;
+}
+
+} // namespace util
+} // namespace pybag
+
+#endif
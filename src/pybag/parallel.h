@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: Apache-2.0
+/*
+Copyright 2020 Blue Cheetah Analog Design Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef PYBAG_PARALLEL_H
+#define PYBAG_PARALLEL_H
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pybag {
+namespace util {
+
+inline std::size_t get_hardware_threads() {
+    return std::max(std::thread::hardware_concurrency(), 1U);
+}
+
+/** Returns the number of worker threads to use for the given number of tasks.
+ *
+ *  num_threads = 0 means use all hardware threads.  Larger requests are capped at the number of
+ *  hardware threads.
+ */
+inline std::size_t get_num_workers(std::size_t num_threads, std::size_t num_tasks) {
+    auto max_threads = get_hardware_threads();
+    if (num_threads == 0 || num_threads > max_threads) {
+        num_threads = max_threads;
+    }
+    return std::max(std::min(num_threads, num_tasks), static_cast<std::size_t>(1));
+}
+
+/** A process-wide pool of worker threads shared by all parallel operations.
+ *
+ *  The pool has one thread less than the hardware, since the thread that submits work also runs
+ *  tasks.  It is created on first use and intentionally never destroyed: the idle workers block
+ *  on the queue until the process exits, so no static destructor has to join them.
+ */
+class thread_pool {
+  private:
+    std::mutex lock_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> tasks_;
+
+    thread_pool() {
+        for (std::size_t idx = 1; idx < get_hardware_threads(); ++idx) {
+            std::thread([this]() {
+                while (true) {
+                    auto task = std::function<void()>();
+                    {
+                        auto guard = std::unique_lock<std::mutex>(lock_);
+                        ready_.wait(guard, [this]() { return !tasks_.empty(); });
+                        task = std::move(tasks_.front());
+                        tasks_.pop_front();
+                    }
+                    task();
+                }
+            }).detach();
+        }
+    }
+
+  public:
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    static thread_pool &get() {
+        static auto *pool = new thread_pool();
+        return *pool;
+    }
+
+    void submit(std::function<void()> &&task) {
+        {
+            auto guard = std::lock_guard<std::mutex>(lock_);
+            tasks_.push_back(std::move(task));
+        }
+        ready_.notify_one();
+    }
+
+    // runs one queued task on the calling thread.  Returns false if the queue is empty.
+    bool run_one() {
+        auto task = std::function<void()>();
+        {
+            auto guard = std::lock_guard<std::mutex>(lock_);
+            if (tasks_.empty())
+                return false;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+        return true;
+    }
+};
+
+// returns the [start, stop) range of the idx-th of num_chunks contiguous chunks of [0, n).
+inline std::array<std::size_t, 2> get_chunk(std::size_t n, std::size_t num_chunks,
+                                            std::size_t idx) {
+    auto q = n / num_chunks;
+    auto r = n % num_chunks;
+    auto start = idx * q + std::min(idx, r);
+    return {start, start + q + (idx < r)};
+}
+
+/** Calls fun(idx) for idx in [0, num_workers) on the shared thread pool.
+ *
+ *  The calling thread runs idx = 0, then runs queued tasks until all calls return, so nested
+ *  calls cannot deadlock the pool.  Rethrows the first exception (by index) raised by any call.
+ *  fun must not touch Python objects.
+ */
+template <class Fun> void run_workers(std::size_t num_workers, Fun fun) {
+    if (num_workers <= 1) {
+        fun(0);
+        return;
+    }
+
+    auto errors = std::vector<std::exception_ptr>(num_workers);
+    auto call = [&fun, &errors](std::size_t idx) {
+        try {
+            fun(idx);
+        } catch (...) {
+            errors[idx] = std::current_exception();
+        }
+    };
+
+    // the tasks notify while holding done_lock, so it outlives every notification.
+    auto done_lock = std::mutex();
+    auto done = std::condition_variable();
+    auto num_left = num_workers - 1;
+    auto &pool = thread_pool::get();
+    for (std::size_t idx = 1; idx < num_workers; ++idx) {
+        pool.submit([&, idx]() {
+            call(idx);
+            auto guard = std::lock_guard<std::mutex>(done_lock);
+            --num_left;
+            done.notify_all();
+        });
+    }
+    call(0);
+    while (pool.run_one()) {
+    }
+    {
+        auto guard = std::unique_lock<std::mutex>(done_lock);
+        done.wait(guard, [&num_left]() { return num_left == 0; });
+    }
+    for (const auto &err : errors) {
+        if (err)
+            std::rethrow_exception(err);
+    }
+}
+
+} // namespace util
+} // namespace pybag
+
+#endif
@@ -47,6 +47,9 @@ limitations under the License.
 #ifndef PYBAG_PY_PT_VECTOR_H
 #define PYBAG_PY_PT_VECTOR_H
 
+#include <cstddef>
+#include <iterator>
+
 #include <pybind11_generics/list.h>
 #include <pybind11_generics/tuple.h>
 
@@ -54,9 +57,66 @@ limitations under the License.
 #include <cbag/layout/pt_list.h>
 #include <cbag/polygon/tag.h>
 
+#include <pybag/numpy_util.h>
+
 using py_point = pybind11_generics::Tuple<cbag::coord_t, cbag::coord_t>;
 using py_pt_vector = pybind11_generics::List<py_point>;
 
+// a point in a py_pt_array.
+struct py_pt_array_point {
+    const cbag::coord_t *ptr = nullptr;
+};
+
+/** A view of the points in a C-contiguous (N, 2) NumPy array.
+ *
+ *  Coordinates are read directly from the array buffer, so no Python objects are touched and the
+ *  GIL may be released while it is used.  The array must outlive this view.
+ */
+class py_pt_array {
+  public:
+    class const_iterator {
+      private:
+        const cbag::coord_t *ptr_ = nullptr;
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = py_pt_array_point;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = py_pt_array_point;
+
+        const_iterator() = default;
+        explicit const_iterator(const cbag::coord_t *ptr) : ptr_(ptr) {}
+
+        reference operator*() const { return {ptr_}; }
+        const_iterator &operator++() {
+            ptr_ += 2;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            auto ans = *this;
+            ptr_ += 2;
+            return ans;
+        }
+        bool operator==(const const_iterator &rhs) const { return ptr_ == rhs.ptr_; }
+        bool operator!=(const const_iterator &rhs) const { return ptr_ != rhs.ptr_; }
+    };
+
+  private:
+    const cbag::coord_t *data_ = nullptr;
+    std::size_t size_ = 0;
+
+  public:
+    explicit py_pt_array(const pybag::util::py_coord_array &arr)
+        : data_(arr.data()), size_(pybag::util::num_points(arr)) {}
+
+    std::size_t size() const noexcept { return size_; }
+    cbag::coord_t x(std::size_t idx) const { return data_[2 * idx]; }
+    cbag::coord_t y(std::size_t idx) const { return data_[2 * idx + 1]; }
+    const_iterator begin() const { return const_iterator(data_); }
+    const_iterator end() const { return const_iterator(data_ + 2 * size_); }
+};
+
 namespace cbag {
 
 namespace polygon {
@@ -72,6 +132,17 @@ template <> struct point_traits<py_point> {
     }
 };
 
+template <> struct tag<py_pt_array_point> { using type = point_tag; };
+
+template <> struct point_traits<py_pt_array_point> {
+    using point_type = py_pt_array_point;
+    using coordinate_type = coord_t;
+
+    static coordinate_type get(const point_type &point, orientation_2d orient) {
+        return point.ptr[to_int(orient)];
+    }
+};
+
 } // namespace polygon
 
 namespace layout {
@@ -87,6 +158,16 @@ template <> struct pt_list<py_pt_vector> {
     static auto end(const py_pt_vector &vec) -> decltype(vec.end()) { return vec.end(); }
 };
 
+template <> struct pt_list<py_pt_array> {
+    using coordinate_type = coord_t;
+
+    static std::size_t size(const py_pt_array &vec) { return vec.size(); }
+    static coordinate_type x(const py_pt_array &vec, std::size_t idx) { return vec.x(idx); }
+    static coordinate_type y(const py_pt_array &vec, std::size_t idx) { return vec.y(idx); }
+    static auto begin(const py_pt_array &vec) -> decltype(vec.begin()) { return vec.begin(); }
+    static auto end(const py_pt_array &vec) -> decltype(vec.end()) { return vec.end(); }
+};
+
 } // namespace traits
 } // namespace layout
 } // namespace cbag
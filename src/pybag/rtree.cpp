@@ -15,16 +15,34 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <boost/geometry.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include <fmt/core.h>
+
+#include <pybind11/numpy.h>
 
 #include <cbag/common/typedefs.h>
 #include <cbag/polygon/boost_adapt.h>
 
 #include <pybind11_generics/iterator.h>
 
+#include <pybag/bbox_collection.h>
+#include <pybag/numpy_util.h>
+#include <pybag/parallel.h>
 #include <pybag/rtree.h>
 
 namespace pybag {
@@ -32,40 +50,188 @@ namespace util {
 
 namespace bg = boost::geometry;
 namespace bgi = boost::geometry::index;
+namespace bip = boost::interprocess;
+
+template <class Query>
+csr_ids query_chunk(const coord_t *boxes, std::size_t start, std::size_t stop, Query query) {
+    auto ans = csr_ids(stop - start);
+    for (auto idx = start; idx < stop; ++idx) {
+        query(get_box(boxes, idx), ans.ids);
+        ans.end_row();
+    }
+    return ans;
+}
+
+// splits the queries into contiguous chunks, one per worker, and concatenates the results in
+// order, so the output does not depend on the number of threads.
+template <class Query>
+csr_ids query_batch(const coord_t *boxes, std::size_t n, std::size_t num_threads, Query query) {
+    auto num_workers = get_num_workers(num_threads, n);
+    if (num_workers == 1) {
+        return query_chunk(boxes, 0, n, query);
+    }
+
+    auto results = std::vector<csr_ids>(num_workers);
+    run_workers(num_workers, [&](std::size_t idx) {
+        auto [start, stop] = get_chunk(n, num_workers, idx);
+        results[idx] = query_chunk(boxes, start, stop, query);
+    });
+    auto ans = std::move(results[0]);
+    for (std::size_t idx = 1; idx < num_workers; ++idx) {
+        ans.extend(results[idx]);
+    }
+    return ans;
+}
 
-class rtree {
+/** An RTree mapping bounding boxes to values of the given type.
+ *
+ *  IDs are assigned sequentially on insertion and never reused.  Boxes and values are stored in a
+ *  hash map keyed by ID, so removed objects release their storage immediately.
+ *
+ *  Thread safety: const queries only read index_, so any number of them may run concurrently,
+ *  which is what the parallel batch queries do.  No query may run concurrently with a
+ *  modification.  Batch queries run with the GIL released, so Python code must not modify an
+ *  RTree from another thread while a batch query on it is in progress.
+ */
+template <class Value> class rtree {
   public:
     using coordinate_type = cbag::coord_t;
     using point_type = bg::model::point<coordinate_type, 2, bg::cs::cartesian>;
     using box_type = cbag::polygon::rectangle_data<coordinate_type>;
+    using value_type = Value;
     using tree_value_type = std::pair<box_type, std::size_t>;
     using tree_type = bgi::rtree<tree_value_type, bgi::quadratic<32, 16>>;
     using const_iterator = typename tree_type::const_iterator;
     using const_query_iterator = typename tree_type::const_query_iterator;
 
   private:
+    using val_map_type = std::unordered_map<std::size_t, std::pair<box_type, value_type>>;
+
     tree_type index_;
-    std::unordered_map<std::size_t, std::pair<box_type, py::object>> val_map_;
-    std::size_t cnt_ = 0;
+    val_map_type val_map_;
+    std::size_t next_id_ = 0;
+
+    typename val_map_type::iterator find_id(std::size_t id) {
+        auto iter = val_map_.find(id);
+        if (iter == val_map_.end()) {
+            throw std::out_of_range("Cannot find id in rtree.");
+        }
+        return iter;
+    }
+
+    typename val_map_type::const_iterator find_id(std::size_t id) const {
+        auto iter = val_map_.find(id);
+        if (iter == val_map_.end()) {
+            throw std::out_of_range("Cannot find id in rtree.");
+        }
+        return iter;
+    }
+
+    template <class Predicate>
+    void append_ids(const Predicate &pred, std::vector<py_id_t> &ans) const {
+        index_.query(pred, boost::make_function_output_iterator([&ans](const tree_value_type &v) {
+                         ans.push_back(static_cast<py_id_t>(v.second));
+                     }));
+    }
+
+    template <class Predicate> std::vector<py_id_t> query_ids(const Predicate &pred) const {
+        auto ans = std::vector<py_id_t>();
+        append_ids(pred, ans);
+        return ans;
+    }
+
+    // returns the squared euclidean distance between the two boxes.
+    static double get_dist2(const box_type &a, const box_type &b) {
+        auto dx = std::max({static_cast<double>(xl(a)) - xh(b), static_cast<double>(xl(b)) - xh(a),
+                            0.0});
+        auto dy = std::max({static_cast<double>(yl(a)) - yh(b), static_cast<double>(yl(b)) - yh(a),
+                            0.0});
+        return dx * dx + dy * dy;
+    }
+
+    static void check_num_nearest(std::size_t k) {
+        if (k == 0)
+            throw std::invalid_argument("rtree nearest query needs k >= 1.");
+    }
+
+    // k must be positive.  It is clamped to the number of objects, so a huge k cannot overflow.
+    void append_nearest(const box_type &box, std::size_t k, std::vector<py_id_t> &ans) const {
+        k = std::min({k, size(), static_cast<std::size_t>(std::numeric_limits<unsigned>::max())});
+        if (k == 0)
+            return;
+        auto hits = std::vector<std::pair<double, py_id_t>>();
+        hits.reserve(k);
+        index_.query(bgi::nearest(box, static_cast<unsigned>(k)),
+                     boost::make_function_output_iterator([&box, &hits](const tree_value_type &v) {
+                         hits.emplace_back(get_dist2(box, v.first),
+                                           static_cast<py_id_t>(v.second));
+                     }));
+        std::sort(hits.begin(), hits.end());
+        for (const auto &[dist2, id] : hits) {
+            ans.push_back(id);
+        }
+    }
+
+    void append_within(const box_type &box, offset_t dist, std::vector<py_id_t> &ans) const {
+        if (dist < 0)
+            throw std::invalid_argument("rtree query distance cannot be negative.");
+        // bloat the query box to find candidates, then keep those within euclidean distance.
+        auto clip = [](std::int64_t val) {
+            return static_cast<coordinate_type>(
+                std::clamp(val, static_cast<std::int64_t>(std::numeric_limits<coordinate_type>::min()),
+                           static_cast<std::int64_t>(std::numeric_limits<coordinate_type>::max())));
+        };
+        auto bloat = box_type{clip(static_cast<std::int64_t>(xl(box)) - dist),
+                              clip(static_cast<std::int64_t>(yl(box)) - dist),
+                              clip(static_cast<std::int64_t>(xh(box)) + dist),
+                              clip(static_cast<std::int64_t>(yh(box)) + dist)};
+        auto dist2 = static_cast<double>(dist) * dist;
+        index_.query(bgi::intersects(bloat) && bgi::satisfies([&box, dist2](const tree_value_type &v) {
+                         return get_dist2(box, v.first) <= dist2;
+                     }),
+                     boost::make_function_output_iterator([&ans](const tree_value_type &v) {
+                         ans.push_back(static_cast<py_id_t>(v.second));
+                     }));
+    }
 
   public:
     rtree() = default;
 
+    /** Creates an RTree from the given boxes and values using the packing (STR) algorithm.
+     *
+     *  Bulk loading is much faster than repeated insertion, and produces a better balanced tree.
+     *  The i-th box/value pair gets ID i.
+     */
+    rtree(std::vector<box_type> &&boxes, std::vector<value_type> &&vals)
+        : next_id_(boxes.size()) {
+        if (vals.size() != boxes.size()) {
+            throw std::invalid_argument("rtree boxes and values must have the same length.");
+        }
+        val_map_.reserve(next_id_);
+        for (std::size_t id = 0; id < next_id_; ++id) {
+            val_map_.emplace(id, std::make_pair(std::move(boxes[id]), std::move(vals[id])));
+        }
+        compact();
+    }
+
     bool empty() const noexcept { return val_map_.empty(); }
 
+    std::size_t size() const noexcept { return val_map_.size(); }
+
+    // returns one past the largest ID ever assigned.
+    std::size_t id_end() const noexcept { return next_id_; }
+
+    bool has_id(std::size_t id) const { return val_map_.find(id) != val_map_.end(); }
+
     box_type get_bbox() const {
         auto tmp = index_.bounds();
         return {tmp.min_corner().template get<0>(), tmp.min_corner().template get<1>(),
                 tmp.max_corner().template get<0>(), tmp.max_corner().template get<1>()};
     }
 
-    py::object get_value(std::size_t id) const {
-        auto iter = val_map_.find(id);
-        if (iter == val_map_.end()) {
-            throw std::out_of_range("Cannot find id in rtree.");
-        }
-        return iter->second.second;
-    }
+    const value_type &get_value(std::size_t id) const { return find_id(id)->second.second; }
+
+    const box_type &get_box(std::size_t id) const { return find_id(id)->second.first; }
 
     const_iterator begin() const { return index_.begin(); }
     const_iterator end() const { return index_.end(); }
@@ -78,68 +244,885 @@ class rtree {
     }
     const_query_iterator qend() const { return index_.qend(); }
 
-    std::size_t insert(py::object &&obj, box_type &&box) {
-        auto ans = cnt_;
+    std::vector<py_id_t> intersect_ids(const box_type &box) const {
+        return query_ids(bgi::intersects(box));
+    }
+    std::vector<py_id_t> overlap_ids(const box_type &box) const {
+        return query_ids(bgi::overlaps(box));
+    }
+
+    // returns the IDs of the k closest objects, sorted by distance.
+    std::vector<py_id_t> nearest_ids(const box_type &box, std::size_t k) const {
+        check_num_nearest(k);
+        auto ans = std::vector<py_id_t>();
+        append_nearest(box, k, ans);
+        return ans;
+    }
+
+    // returns the IDs of all objects within the given euclidean distance.
+    std::vector<py_id_t> within_ids(const box_type &box, offset_t dist) const {
+        auto ans = std::vector<py_id_t>();
+        append_within(box, dist, ans);
+        return ans;
+    }
+
+    // boxes is a (n, 4) row-major array.  Does not touch any Python objects.
+    csr_ids intersect_batch(const coord_t *boxes, std::size_t n, std::size_t num_threads) const {
+        return query_batch(boxes, n, num_threads,
+                           [this](const box_type &box, std::vector<py_id_t> &ans) {
+                               append_ids(bgi::intersects(box), ans);
+                           });
+    }
+    csr_ids overlap_batch(const coord_t *boxes, std::size_t n, std::size_t num_threads) const {
+        return query_batch(boxes, n, num_threads,
+                           [this](const box_type &box, std::vector<py_id_t> &ans) {
+                               append_ids(bgi::overlaps(box), ans);
+                           });
+    }
+    csr_ids nearest_batch(const coord_t *boxes, std::size_t n, std::size_t k,
+                          std::size_t num_threads) const {
+        check_num_nearest(k);
+        return query_batch(boxes, n, num_threads,
+                           [this, k](const box_type &box, std::vector<py_id_t> &ans) {
+                               append_nearest(box, k, ans);
+                           });
+    }
+    csr_ids within_batch(const coord_t *boxes, std::size_t n, offset_t dist,
+                         std::size_t num_threads) const {
+        if (dist < 0)
+            throw std::invalid_argument("rtree query distance cannot be negative.");
+        return query_batch(boxes, n, num_threads,
+                           [this, dist](const box_type &box, std::vector<py_id_t> &ans) {
+                               append_within(box, dist, ans);
+                           });
+    }
+
+    std::size_t insert(value_type &&val, box_type &&box) {
+        auto ans = next_id_++;
         index_.insert(tree_value_type(box, ans));
-        val_map_.emplace(ans, std::make_pair(std::move(box), std::move(obj)));
-        ++cnt_;
+        val_map_.emplace(ans, std::make_pair(std::move(box), std::move(val)));
         return ans;
     }
 
-    py::object pop(std::size_t id) {
-        auto iter = val_map_.find(id);
-        if (iter == val_map_.end()) {
+    value_type pop(std::size_t id) {
+        auto iter = find_id(id);
+        index_.remove(tree_value_type(iter->second.first, id));
+        auto ans = std::move(iter->second.second);
+        val_map_.erase(iter);
+        return ans;
+    }
+
+    /** Removes all the given IDs and returns their values.
+     *
+     *  All IDs are checked before anything is removed, so an invalid ID leaves this RTree
+     *  unchanged.  If a large fraction of the tree is removed, the tree is rebuilt with compact()
+     *  instead of removing entries one by one.
+     */
+    std::vector<value_type> pop_many(const py_id_t *ids, std::size_t n) {
+        auto sorted_ids = std::vector<std::size_t>(ids, ids + n);
+        std::sort(sorted_ids.begin(), sorted_ids.end());
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            if (idx > 0 && sorted_ids[idx] == sorted_ids[idx - 1])
+                throw std::invalid_argument("Duplicate id in rtree removal list.");
+            find_id(sorted_ids[idx]);
+        }
+
+        auto rebuild = 4 * n > size();
+        auto ans = std::vector<value_type>();
+        ans.reserve(n);
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            auto iter = find_id(static_cast<std::size_t>(ids[idx]));
+            if (!rebuild)
+                index_.remove(tree_value_type(iter->second.first, iter->first));
+            ans.push_back(std::move(iter->second.second));
+            val_map_.erase(iter);
+        }
+        if (rebuild)
+            compact();
+        return ans;
+    }
+
+    // removes all objects that intersects the given box, and returns their IDs.
+    std::vector<py_id_t> remove_in(const box_type &box) {
+        auto ans = intersect_ids(box);
+        pop_many(ans.data(), ans.size());
+        return ans;
+    }
+
+    /** Rebuilds the tree from the remaining objects with the packing algorithm.
+     *
+     *  Call this after many insertions and removals to restore a well balanced tree.  The ID map
+     *  is rehashed to fit the remaining objects.  IDs are unchanged.
+     */
+    void compact() {
+        auto tree_vals = std::vector<tree_value_type>();
+        tree_vals.reserve(size());
+        for (const auto &[id, item] : val_map_) {
+            tree_vals.emplace_back(item.first, id);
+        }
+        index_ = tree_type(tree_vals.begin(), tree_vals.end());
+        val_map_.rehash(0);
+    }
+
+    // calls fun(id, box, value) for every object, in no particular order.
+    template <class Fun> void for_each(Fun fun) const {
+        for (const auto &[id, item] : val_map_) {
+            fun(id, item.first, item.second);
+        }
+    }
+};
+
+using py_rtree = rtree<py::object>;
+using int_rtree = rtree<py_id_t>;
+using box_rtree = rtree<cbag::box_t>;
+
+void read_values(std::vector<py::object> &ans, const py::object &values,
+                 const std::vector<cbag::box_t> &boxes) {
+    if (values.is_none()) {
+        ans.resize(boxes.size(), py::none());
+    } else {
+        for (auto item : values) {
+            ans.emplace_back(py::reinterpret_borrow<py::object>(item));
+        }
+    }
+}
+
+void read_values(std::vector<py_id_t> &ans, const py::object &values,
+                 const std::vector<cbag::box_t> &boxes) {
+    if (values.is_none()) {
+        ans.reserve(boxes.size());
+        for (std::size_t idx = 0; idx < boxes.size(); ++idx) {
+            ans.push_back(static_cast<py_id_t>(idx));
+        }
+    } else {
+        auto arr = values.cast<py_id_array>();
+        ans.assign(arr.data(), arr.data() + arr.size());
+    }
+}
+
+void read_values(std::vector<cbag::box_t> &ans, const py::object &values,
+                 const std::vector<cbag::box_t> &boxes) {
+    if (values.is_none()) {
+        ans = boxes;
+    } else {
+        ans = boxes_from_numpy(values.cast<py_coord_array>());
+    }
+}
+
+template <class Value>
+rtree<Value> make_rtree(std::vector<cbag::box_t> &&boxes, const py::object &values) {
+    auto vals = std::vector<Value>();
+    read_values(vals, values, boxes);
+    return {std::move(boxes), std::move(vals)};
+}
+
+/** Snapshot file format, written by save_snapshot() and read by mapped_rtree.
+ *
+ *  The file contains a header followed by these sections, each starting on an 8-byte boundary:
+ *
+ *  1. level_ends: uint64[num_levels], the end node position of each tree level.
+ *  2. node_boxes: coord_t[num_nodes][4], the [xl, yl, xh, yh] of each node.
+ *  3. node_index: int64[num_nodes].  For leaves (level 0) this is the object ID, otherwise the
+ *     node position of the first child.  Each node has at most node_size children.
+ *  4. id_pos: int64[id_end], the leaf position of each ID, or -1 if the ID was removed.
+ *  5. payload: one entry per leaf position, int64 for RTreeInt, coord_t[4] for RTreeBox, and
+ *     absent for RTree, since Python objects are not saved.
+ *
+ *  Leaves are sorted along a Hilbert curve and packed bottom-up, so the layout can be queried
+ *  directly from the mapped file without any construction at load time.
+ */
+enum class payload_kind : std::uint32_t {
+    none = 0,
+    integer = 1,
+    box = 2,
+};
+
+struct snapshot_header {
+    std::array<char, 8> magic;
+    std::uint32_t byte_order;
+    std::uint32_t version;
+    std::uint32_t coord_size;
+    std::uint32_t node_size;
+    payload_kind payload;
+    std::uint32_t num_levels;
+    std::uint64_t num_items;
+    std::uint64_t num_nodes;
+    std::uint64_t id_end;
+};
+
+constexpr std::array<char, 8> snapshot_magic = {'P', 'Y', 'B', 'A', 'G', 'R', 'T', '\0'};
+constexpr std::uint32_t snapshot_byte_order = 0x01020304;
+constexpr std::uint32_t snapshot_version = 1;
+constexpr std::uint32_t snapshot_node_size = 16;
+
+template <class Value> struct snapshot_traits {};
+
+template <> struct snapshot_traits<py::object> {
+    static constexpr payload_kind kind = payload_kind::none;
+    static void write(std::ostream &, const py::object &) {}
+};
+
+template <> struct snapshot_traits<py_id_t> {
+    static constexpr payload_kind kind = payload_kind::integer;
+    static void write(std::ostream &os, py_id_t val) {
+        os.write(reinterpret_cast<const char *>(&val), sizeof(val));
+    }
+};
+
+template <> struct snapshot_traits<cbag::box_t> {
+    static constexpr payload_kind kind = payload_kind::box;
+    static void write(std::ostream &os, const cbag::box_t &val) {
+        auto tmp = std::array<coord_t, 4>{xl(val), yl(val), xh(val), yh(val)};
+        os.write(reinterpret_cast<const char *>(tmp.data()), sizeof(tmp));
+    }
+};
+
+inline std::size_t align8(std::size_t val) { return (val + 7) & ~static_cast<std::size_t>(7); }
+
+// returns the Hilbert curve index of (x, y) on a 2^16 by 2^16 grid.
+inline std::uint64_t hilbert_index(std::uint32_t x, std::uint32_t y) {
+    constexpr std::uint32_t n = 1U << 16;
+    std::uint64_t ans = 0;
+    for (auto s = n / 2; s > 0; s /= 2) {
+        std::uint32_t rx = (x & s) > 0;
+        std::uint32_t ry = (y & s) > 0;
+        ans += static_cast<std::uint64_t>(s) * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return ans;
+}
+
+// maps the center coordinate of [lo, hi] in the range [min_val, max_val] onto [0, 2^16).
+inline std::uint32_t hilbert_coord(coord_t lo, coord_t hi, std::int64_t min_val,
+                                   std::int64_t max_val) {
+    auto span = 2 * (max_val - min_val);
+    if (span == 0)
+        return 0;
+    auto center = static_cast<std::int64_t>(lo) + hi - 2 * min_val;
+    return static_cast<std::uint32_t>((static_cast<double>(center) / span) * 0xFFFF);
+}
+
+/** A packed (static) RTree built bottom-up from Hilbert-sorted leaves. */
+struct packed_tree {
+    std::vector<std::uint64_t> level_ends;
+    std::vector<coord_t> boxes;
+    std::vector<py_id_t> index;
+    std::vector<std::size_t> order;
+
+    explicit packed_tree(const std::vector<std::pair<cbag::box_t, std::size_t>> &items) {
+        auto n = items.size();
+        if (n == 0)
+            return;
+
+        auto bnd = cbag::box_t::get_invalid_bbox();
+        for (const auto &[box, id] : items) {
+            bnd |= box;
+        }
+        auto keys = std::vector<std::pair<std::uint64_t, std::size_t>>();
+        keys.reserve(n);
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            const auto &box = items[idx].first;
+            auto hx = hilbert_coord(xl(box), xh(box), xl(bnd), xh(bnd));
+            auto hy = hilbert_coord(yl(box), yh(box), yl(bnd), yh(bnd));
+            keys.emplace_back(hilbert_index(hx, hy), items[idx].second);
+        }
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+                  [&keys](std::size_t a, std::size_t b) { return keys[a] < keys[b]; });
+
+        boxes.reserve(8 * n);
+        index.reserve(2 * n);
+        for (auto idx : order) {
+            add_node(items[idx].first, static_cast<py_id_t>(items[idx].second));
+        }
+        level_ends.push_back(n);
+
+        // always add at least one internal level, so the root is never a leaf.
+        std::size_t start = 0;
+        do {
+            auto stop = level_ends.back();
+            for (auto pos = start; pos < stop; pos += snapshot_node_size) {
+                auto child_stop = std::min(pos + snapshot_node_size, stop);
+                auto node_box = cbag::box_t::get_invalid_bbox();
+                for (auto child = pos; child < child_stop; ++child) {
+                    node_box |= get_box(boxes.data(), child);
+                }
+                add_node(node_box, static_cast<py_id_t>(pos));
+            }
+            start = stop;
+            level_ends.push_back(index.size());
+        } while (level_ends.back() - start > 1);
+    }
+
+    void add_node(const cbag::box_t &box, py_id_t idx) {
+        boxes.insert(boxes.end(), {xl(box), yl(box), xh(box), yh(box)});
+        index.push_back(idx);
+    }
+};
+
+template <class Value> void save_snapshot(const rtree<Value> &tree, const std::string &fname) {
+    using traits = snapshot_traits<Value>;
+
+    auto items = std::vector<std::pair<cbag::box_t, std::size_t>>();
+    items.reserve(tree.size());
+    tree.for_each([&items](std::size_t id, const cbag::box_t &box, const Value &) {
+        items.emplace_back(box, id);
+    });
+    auto packed = packed_tree(items);
+
+    auto id_pos = std::vector<py_id_t>(tree.id_end(), -1);
+    for (std::size_t pos = 0; pos < packed.order.size(); ++pos) {
+        id_pos[items[packed.order[pos]].second] = static_cast<py_id_t>(pos);
+    }
+
+    auto header = snapshot_header{snapshot_magic,
+                                  snapshot_byte_order,
+                                  snapshot_version,
+                                  static_cast<std::uint32_t>(sizeof(coord_t)),
+                                  snapshot_node_size,
+                                  traits::kind,
+                                  static_cast<std::uint32_t>(packed.level_ends.size()),
+                                  static_cast<std::uint64_t>(items.size()),
+                                  static_cast<std::uint64_t>(packed.index.size()),
+                                  static_cast<std::uint64_t>(tree.id_end())};
+
+    auto os = std::ofstream(fname, std::ios::binary | std::ios::trunc);
+    if (!os)
+        throw std::runtime_error(fmt::format("Cannot open file {} for writing.", fname));
+    auto write_section = [&os](const auto &vec) {
+        auto pos = static_cast<std::size_t>(os.tellp());
+        auto pad = std::array<char, 8>{};
+        os.write(pad.data(), align8(pos) - pos);
+        os.write(reinterpret_cast<const char *>(vec.data()),
+                 vec.size() * sizeof(typename std::decay_t<decltype(vec)>::value_type));
+    };
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    write_section(packed.level_ends);
+    write_section(packed.boxes);
+    write_section(packed.index);
+    write_section(id_pos);
+    write_section(std::vector<char>());
+    for (auto idx : packed.order) {
+        traits::write(os, tree.get_value(items[idx].second));
+    }
+    if (!os)
+        throw std::runtime_error(fmt::format("Error writing rtree snapshot to {}.", fname));
+}
+
+/** A read-only RTree backed by a memory-mapped snapshot file.
+ *
+ *  Opening a snapshot maps the file and validates the header, the level table, the node index
+ *  and the ID table, so queries on a corrupt file cannot read out of bounds.  The boxes and the
+ *  payload are loaded lazily by the OS as queries touch them.  All queries are const, so they can
+ *  run concurrently.
+ */
+class mapped_rtree {
+  public:
+    using box_type = cbag::box_t;
+
+  private:
+    bip::file_mapping file_;
+    bip::mapped_region region_;
+    const snapshot_header *header_ = nullptr;
+    const std::uint64_t *level_ends_ = nullptr;
+    const coord_t *boxes_ = nullptr;
+    const py_id_t *index_ = nullptr;
+    const py_id_t *id_pos_ = nullptr;
+    const char *payload_ = nullptr;
+
+    // returns the section of num groups of width elements of type T at the given offset.
+    template <class T>
+    const T *get_section(std::size_t &offset, std::uint64_t num, std::size_t width = 1) const {
+        offset = align8(offset);
+        auto size = region_.get_size();
+        if (offset > size || num > (size - offset) / (width * sizeof(T)))
+            throw std::runtime_error("rtree snapshot file is truncated.");
+        auto *ans = reinterpret_cast<const T *>(static_cast<const char *>(region_.get_address()) +
+                                                offset);
+        offset += num * width * sizeof(T);
+        return ans;
+    }
+
+    /** Checks the structure of the tree.
+     *
+     *  level_ends must increase up to num_nodes with one root, each internal node must point into
+     *  the level below, each leaf must hold an ID below id_end, and each ID must map to a leaf.
+     */
+    void validate(const std::string &fname) const {
+        auto corrupt = [&fname]() {
+            return std::runtime_error(fmt::format("rtree snapshot {} is corrupt.", fname));
+        };
+        auto num_levels = header_->num_levels;
+        auto num_items = header_->num_items;
+        auto num_nodes = header_->num_nodes;
+        auto id_end = header_->id_end;
+        if (num_levels == 0) {
+            if (num_items != 0 || num_nodes != 0)
+                throw corrupt();
+        } else {
+            // the root is never a leaf.
+            if (num_levels == 1 || header_->node_size == 0 || level_ends_[0] != num_items ||
+                level_ends_[num_levels - 1] != num_nodes)
+                throw corrupt();
+            for (std::uint32_t lev = 1; lev < num_levels; ++lev) {
+                if (level_ends_[lev] <= level_ends_[lev - 1])
+                    throw corrupt();
+            }
+            if (num_nodes - level_ends_[num_levels - 2] != 1)
+                throw corrupt();
+        }
+
+        for (std::uint64_t pos = 0; pos < num_items; ++pos) {
+            if (index_[pos] < 0 || static_cast<std::uint64_t>(index_[pos]) >= id_end)
+                throw corrupt();
+        }
+        for (std::uint32_t lev = 1; lev < num_levels; ++lev) {
+            auto child_start = (lev == 1) ? 0 : level_ends_[lev - 2];
+            auto child_stop = level_ends_[lev - 1];
+            for (auto pos = level_ends_[lev - 1]; pos < level_ends_[lev]; ++pos) {
+                if (index_[pos] < 0 || static_cast<std::uint64_t>(index_[pos]) < child_start ||
+                    static_cast<std::uint64_t>(index_[pos]) >= child_stop)
+                    throw corrupt();
+            }
+        }
+        for (std::uint64_t id = 0; id < id_end; ++id) {
+            if (id_pos_[id] < -1 ||
+                (id_pos_[id] >= 0 && static_cast<std::uint64_t>(id_pos_[id]) >= num_items))
+                throw corrupt();
+        }
+    }
+
+    template <class LeafPredicate>
+    void append_ids(const box_type &box, LeafPredicate leaf_pred, std::vector<py_id_t> &ans) const {
+        auto num_levels = header_->num_levels;
+        if (num_levels == 0)
+            return;
+
+        auto root = level_ends_[num_levels - 1] - 1;
+        if (!bg::intersects(box, util::get_box(boxes_, root)))
+            return;
+        auto stack = std::vector<std::pair<std::uint32_t, std::uint64_t>>();
+        stack.emplace_back(num_levels - 1, root);
+        while (!stack.empty()) {
+            auto [lev, pos] = stack.back();
+            stack.pop_back();
+            auto start = static_cast<std::uint64_t>(index_[pos]);
+            auto stop = std::min(start + header_->node_size, level_ends_[lev - 1]);
+            for (auto child = start; child < stop; ++child) {
+                auto child_box = util::get_box(boxes_, child);
+                if (lev == 1) {
+                    if (leaf_pred(child_box))
+                        ans.push_back(index_[child]);
+                } else if (bg::intersects(box, child_box)) {
+                    stack.emplace_back(lev - 1, child);
+                }
+            }
+        }
+    }
+
+    std::size_t get_pos(std::size_t id) const {
+        if (id >= header_->id_end || id_pos_[id] < 0)
             throw std::out_of_range("Cannot find id in rtree.");
+        return static_cast<std::size_t>(id_pos_[id]);
+    }
+
+  public:
+    explicit mapped_rtree(const std::string &fname)
+        : file_(fname.c_str(), bip::read_only), region_(file_, bip::read_only) {
+        if (region_.get_size() < sizeof(snapshot_header))
+            throw std::runtime_error(fmt::format("{} is not an rtree snapshot file.", fname));
+        header_ = static_cast<const snapshot_header *>(region_.get_address());
+        if (header_->magic != snapshot_magic)
+            throw std::runtime_error(fmt::format("{} is not an rtree snapshot file.", fname));
+        if (header_->byte_order != snapshot_byte_order ||
+            header_->coord_size != sizeof(coord_t))
+            throw std::runtime_error(
+                fmt::format("rtree snapshot {} was written on an incompatible platform.", fname));
+        if (header_->version != snapshot_version)
+            throw std::runtime_error(fmt::format("Unsupported rtree snapshot version {}.",
+                                                 header_->version));
+
+        std::size_t offset = sizeof(snapshot_header);
+        level_ends_ = get_section<std::uint64_t>(offset, header_->num_levels);
+        boxes_ = get_section<coord_t>(offset, header_->num_nodes, 4);
+        index_ = get_section<py_id_t>(offset, header_->num_nodes);
+        id_pos_ = get_section<py_id_t>(offset, header_->id_end);
+        switch (header_->payload) {
+        case payload_kind::integer:
+            payload_ = get_section<char>(offset, header_->num_items, sizeof(py_id_t));
+            break;
+        case payload_kind::box:
+            payload_ = get_section<char>(offset, header_->num_items, 4 * sizeof(coord_t));
+            break;
+        default:
+            break;
         }
-        auto ans = iter->second.second;
-        auto val = tree_value_type(iter->second.first, id);
-        index_.remove(val);
-        val_map_.erase(iter);
+        validate(fname);
+    }
+
+    std::size_t size() const noexcept { return header_->num_items; }
+
+    payload_kind get_payload_kind() const noexcept { return header_->payload; }
+
+    box_type get_bbox() const {
+        if (header_->num_levels == 0)
+            return box_type::get_invalid_bbox();
+        return util::get_box(boxes_, level_ends_[header_->num_levels - 1] - 1);
+    }
+
+    box_type get_box(std::size_t id) const { return util::get_box(boxes_, get_pos(id)); }
+
+    py_id_t get_int_value(std::size_t id) const {
+        return reinterpret_cast<const py_id_t *>(payload_)[get_pos(id)];
+    }
+
+    box_type get_box_value(std::size_t id) const {
+        return util::get_box(reinterpret_cast<const coord_t *>(payload_), get_pos(id));
+    }
+
+    void append_intersect(const box_type &box, std::vector<py_id_t> &ans) const {
+        append_ids(box, [&box](const box_type &val) { return bg::intersects(box, val); }, ans);
+    }
+
+    void append_overlap(const box_type &box, std::vector<py_id_t> &ans) const {
+        append_ids(box, [&box](const box_type &val) { return bg::overlaps(val, box); }, ans);
+    }
+
+    std::vector<py_id_t> intersect_ids(const box_type &box) const {
+        auto ans = std::vector<py_id_t>();
+        append_intersect(box, ans);
         return ans;
     }
+
+    std::vector<py_id_t> overlap_ids(const box_type &box) const {
+        auto ans = std::vector<py_id_t>();
+        append_overlap(box, ans);
+        return ans;
+    }
+
+    csr_ids intersect_batch(const coord_t *boxes, std::size_t n, std::size_t num_threads) const {
+        return query_batch(boxes, n, num_threads,
+                           [this](const box_type &box, std::vector<py_id_t> &ans) {
+                               append_intersect(box, ans);
+                           });
+    }
+
+    csr_ids overlap_batch(const coord_t *boxes, std::size_t n, std::size_t num_threads) const {
+        return query_batch(boxes, n, num_threads,
+                           [this](const box_type &box, std::vector<py_id_t> &ans) {
+                               append_overlap(box, ans);
+                           });
+    }
 };
 
+py::list values_to_py(std::vector<py::object> &&vals) {
+    auto ans = py::list(vals.size());
+    for (std::size_t idx = 0; idx < vals.size(); ++idx) {
+        ans[idx] = std::move(vals[idx]);
+    }
+    return ans;
+}
+
+py::array_t<py_id_t> values_to_py(std::vector<py_id_t> &&vals) {
+    return to_numpy(std::move(vals));
+}
+
+py::array_t<coord_t> values_to_py(std::vector<cbag::box_t> &&vals) {
+    return boxes_to_numpy(vals);
+}
+
+template <class Value> auto get_values(const rtree<Value> &self, const py_id_array &ids) {
+    auto n = static_cast<std::size_t>(ids.size());
+    auto *data = ids.data();
+    auto ans = std::vector<Value>();
+    ans.reserve(n);
+    for (std::size_t idx = 0; idx < n; ++idx) {
+        ans.push_back(self.get_value(static_cast<std::size_t>(data[idx])));
+    }
+    return values_to_py(std::move(ans));
+}
+
+py::object get_values(const mapped_rtree &self, const py_id_array &ids) {
+    auto n = static_cast<std::size_t>(ids.size());
+    auto *data = ids.data();
+    switch (self.get_payload_kind()) {
+    case payload_kind::integer: {
+        auto ans = std::vector<py_id_t>();
+        ans.reserve(n);
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            ans.push_back(self.get_int_value(static_cast<std::size_t>(data[idx])));
+        }
+        return values_to_py(std::move(ans));
+    }
+    case payload_kind::box: {
+        auto ans = std::vector<cbag::box_t>();
+        ans.reserve(n);
+        for (std::size_t idx = 0; idx < n; ++idx) {
+            ans.push_back(self.get_box_value(static_cast<std::size_t>(data[idx])));
+        }
+        return values_to_py(std::move(ans));
+    }
+    default:
+        throw std::invalid_argument("This rtree snapshot does not store values.");
+    }
+}
+
 } // namespace util
 } // namespace pybag
 
 namespace pu = pybag::util;
 namespace pyg = pybind11_generics;
 
-void bind_rtree(py::module &m) {
-    pyg::declare_iterator<pu::rtree::const_iterator>();
-    pyg::declare_iterator<pu::rtree::const_query_iterator>();
+template <class Value> void bind_rtree_class(py::class_<pu::rtree<Value>> &py_cls) {
+    using rtree_t = pu::rtree<Value>;
+    using box_type = typename rtree_t::box_type;
 
-    auto py_cls = py::class_<pu::rtree>(m, "RTree");
     py_cls.def(py::init<>(), "Create an empty RTree.");
-    py_cls.def("__bool__", [](const pu::rtree &self) { return !self.empty(); },
+    py_cls.def_static(
+        "from_boxes",
+        [](const c_box_col &boxes, py::object values) {
+            return pu::make_rtree<Value>(pu::get_boxes(boxes), values);
+        },
+        "Bulk load a new RTree from the given BBoxCollection and values.  The i-th box gets ID i.",
+        py::arg("boxes"), py::arg("values") = py::none());
+    py_cls.def_static(
+        "from_boxes",
+        [](const pu::py_coord_array &boxes, py::object values) {
+            return pu::make_rtree<Value>(pu::boxes_from_numpy(boxes), values);
+        },
+        "Bulk load a new RTree from the given (N, 4) box array and values.  The i-th box gets ID i.",
+        py::arg("boxes"), py::arg("values") = py::none());
+    py_cls.def("__bool__", [](const rtree_t &self) { return !self.empty(); },
                "True if this object is not empty.");
+    py_cls.def("__len__", &rtree_t::size, "Returns the number of items in this RTree.");
     py_cls.def("__iter__",
-               [](const pu::rtree &self) { return pyg::make_iterator(self.begin(), self.end()); },
+               [](const rtree_t &self) { return pyg::make_iterator(self.begin(), self.end()); },
                "Iterates over all items in this Rtree.");
     py_cls.def("__getitem__",
-               [](const pu::rtree &self, std::size_t id) { return self.get_value(id); },
+               [](const rtree_t &self, std::size_t id) { return self.get_value(id); },
                "Returns the value corresponding to the given ID.", py::arg("obj_id"));
-    py_cls.def("pop", [](pu::rtree &self, std::size_t id) { return self.pop(id); },
+    py_cls.def("get_values",
+               [](const rtree_t &self, const pu::py_id_array &ids) {
+                   return pu::get_values(self, ids);
+               },
+               "Returns the values corresponding to the given array of IDs.", py::arg("ids"));
+    py_cls.def("get_bbox", &rtree_t::get_box, "Returns the bounding box of the given ID.",
+               py::arg("obj_id"));
+    py_cls.def("pop", [](rtree_t &self, std::size_t id) { return self.pop(id); },
                "Removes the given ID from this RTree and returns the associated value.",
                py::arg("obj_id"));
-    py_cls.def_property_readonly("bound_box", &pu::rtree::get_bbox, "The overall bounding box.");
+    py_cls.def("pop_many",
+               [](rtree_t &self, const pu::py_id_array &ids) {
+                   return pu::values_to_py(
+                       self.pop_many(ids.data(), static_cast<std::size_t>(ids.size())));
+               },
+               "Removes all the given IDs from this RTree and returns the associated values.",
+               py::arg("ids"));
+    py_cls.def("remove_in",
+               [](rtree_t &self, const box_type &box) { return pu::to_numpy(self.remove_in(box)); },
+               "Removes all objects that intersects the given box, and returns their IDs.",
+               py::arg("box"));
+    py_cls.def("compact", &rtree_t::compact,
+               "Rebuilds this RTree to restore a balanced tree after many modifications.");
+    py_cls.def_property_readonly("bound_box", &rtree_t::get_bbox, "The overall bounding box.");
     py_cls.def(
         "intersect_iter",
-        [](const pu::rtree &self, const pu::rtree::box_type &box) {
+        [](const rtree_t &self, const box_type &box) {
             return pyg::make_iterator(self.intersect(box), self.qend());
         },
         "Returns an iterator over all objects that intersects the given box (includes touches).",
         py::arg("box"));
     py_cls.def(
         "overlap_iter",
-        [](const pu::rtree &self, const pu::rtree::box_type &box) {
+        [](const rtree_t &self, const box_type &box) {
             return pyg::make_iterator(self.overlap(box), self.qend());
         },
         "Returns an iterator over all objects that overlaps the given box (excludes touches).",
         py::arg("box"));
+    py_cls.def(
+        "intersect_ids",
+        [](const rtree_t &self, const box_type &box) {
+            return pu::to_numpy(self.intersect_ids(box));
+        },
+        "Returns an array of IDs of all objects that intersects the given box (includes touches).",
+        py::arg("box"));
+    py_cls.def(
+        "overlap_ids",
+        [](const rtree_t &self, const box_type &box) {
+            return pu::to_numpy(self.overlap_ids(box));
+        },
+        "Returns an array of IDs of all objects that overlaps the given box (excludes touches).",
+        py::arg("box"));
+    py_cls.def(
+        "intersect_batch",
+        [](const rtree_t &self, const pu::py_coord_array &boxes, std::size_t num_threads) {
+            auto n = pu::num_boxes(boxes);
+            auto ans = pu::csr_ids();
+            {
+                py::gil_scoped_release release;
+                ans = self.intersect_batch(boxes.data(), n, num_threads);
+            }
+            return pu::to_numpy(std::move(ans));
+        },
+        "Queries all objects that intersects each of the given (N, 4) boxes.  Returns the tuple "
+        "(offsets, ids), where the results of the i-th box are ids[offsets[i]:offsets[i + 1]].  "
+        "Queries are split across num_threads threads (0 to use all cores).",
+        py::arg("boxes"), py::arg("num_threads") = 1);
+    py_cls.def(
+        "overlap_batch",
+        [](const rtree_t &self, const pu::py_coord_array &boxes, std::size_t num_threads) {
+            auto n = pu::num_boxes(boxes);
+            auto ans = pu::csr_ids();
+            {
+                py::gil_scoped_release release;
+                ans = self.overlap_batch(boxes.data(), n, num_threads);
+            }
+            return pu::to_numpy(std::move(ans));
+        },
+        "Queries all objects that overlaps each of the given (N, 4) boxes.  Returns the tuple "
+        "(offsets, ids), where the results of the i-th box are ids[offsets[i]:offsets[i + 1]].  "
+        "Queries are split across num_threads threads (0 to use all cores).",
+        py::arg("boxes"), py::arg("num_threads") = 1);
+    py_cls.def(
+        "nearest_ids",
+        [](const rtree_t &self, const box_type &box, std::size_t k) {
+            return pu::to_numpy(self.nearest_ids(box, k));
+        },
+        "Returns an array of IDs of the k objects closest to the given box, sorted by distance.  "
+        "k must be at least 1, and fewer IDs are returned if this RTree has less than k objects.",
+        py::arg("box"), py::arg("k") = 1);
+    py_cls.def(
+        "within_ids",
+        [](const rtree_t &self, const box_type &box, cbag::offset_t dist) {
+            return pu::to_numpy(self.within_ids(box, dist));
+        },
+        "Returns an array of IDs of all objects within the given euclidean distance of the box.",
+        py::arg("box"), py::arg("dist"));
+    py_cls.def(
+        "nearest_batch",
+        [](const rtree_t &self, const pu::py_coord_array &boxes, std::size_t k,
+           std::size_t num_threads) {
+            auto n = pu::num_boxes(boxes);
+            auto ans = pu::csr_ids();
+            {
+                py::gil_scoped_release release;
+                ans = self.nearest_batch(boxes.data(), n, k, num_threads);
+            }
+            return pu::to_numpy(std::move(ans));
+        },
+        "Finds the k closest objects to each of the given (N, 4) boxes.  Returns (offsets, ids) "
+        "in the same format as intersect_batch.  k must be at least 1.",
+        py::arg("boxes"), py::arg("k") = 1, py::arg("num_threads") = 1);
+    py_cls.def(
+        "within_batch",
+        [](const rtree_t &self, const pu::py_coord_array &boxes, cbag::offset_t dist,
+           std::size_t num_threads) {
+            auto n = pu::num_boxes(boxes);
+            auto ans = pu::csr_ids();
+            {
+                py::gil_scoped_release release;
+                ans = self.within_batch(boxes.data(), n, dist, num_threads);
+            }
+            return pu::to_numpy(std::move(ans));
+        },
+        "Finds all objects within the given euclidean distance of each of the given (N, 4) boxes.  "
+        "Returns (offsets, ids) in the same format as intersect_batch.",
+        py::arg("boxes"), py::arg("dist"), py::arg("num_threads") = 1);
     py_cls.def("insert",
-               [](pu::rtree &self, py::object obj, pu::rtree::box_type box) {
+               [](rtree_t &self, Value obj, box_type box) {
                    return self.insert(std::move(obj), std::move(box));
                },
                "Insert given object into RTree.", py::arg("obj"), py::arg("box"));
+    py_cls.def("save", &pu::save_snapshot<Value>,
+               "Saves this RTree to a snapshot file that can be opened with MappedRTree.  IDs are "
+               "preserved.  Python object values are not saved.",
+               py::arg("fname"));
+}
+
+void bind_mapped_rtree(py::module &m) {
+    using mapped_t = pu::mapped_rtree;
+    using box_type = mapped_t::box_type;
+
+    auto py_cls = py::class_<mapped_t>(m, "MappedRTree");
+    py_cls.doc() = "A read-only RTree memory-mapped from a snapshot file.";
+    py_cls.def(py::init<std::string>(), "Opens the given RTree snapshot file.", py::arg("fname"));
+    py_cls.def("__bool__", [](const mapped_t &self) { return self.size() != 0; },
+               "Returns True if this RTree is not empty.");
+    py_cls.def("__len__", &mapped_t::size, "Returns number of objects in this RTree.");
+    py_cls.def("get_values",
+               [](const mapped_t &self, const pu::py_id_array &ids) {
+                   return pu::get_values(self, ids);
+               },
+               "Returns the values corresponding to the given array of IDs.", py::arg("ids"));
+    py_cls.def("get_bbox", &mapped_t::get_box, "Returns the bounding box of the given ID.",
+               py::arg("obj_id"));
+    py_cls.def_property_readonly("bound_box", &mapped_t::get_bbox, "The overall bounding box.");
+    py_cls.def(
+        "intersect_ids",
+        [](const mapped_t &self, const box_type &box) {
+            return pu::to_numpy(self.intersect_ids(box));
+        },
+        "Returns an array of IDs of all objects that intersects the given box (includes touches).",
+        py::arg("box"));
+    py_cls.def(
+        "overlap_ids",
+        [](const mapped_t &self, const box_type &box) {
+            return pu::to_numpy(self.overlap_ids(box));
+        },
+        "Returns an array of IDs of all objects that overlaps the given box (excludes touches).",
+        py::arg("box"));
+    py_cls.def(
+        "intersect_batch",
+        [](const mapped_t &self, const pu::py_coord_array &boxes, std::size_t num_threads) {
+            auto n = pu::num_boxes(boxes);
+            auto ans = pu::csr_ids();
+            {
+                py::gil_scoped_release release;
+                ans = self.intersect_batch(boxes.data(), n, num_threads);
+            }
+            return pu::to_numpy(std::move(ans));
+        },
+        "Queries all objects that intersects each of the given (N, 4) boxes.  Returns (offsets, "
+        "ids) in the same format as RTree.intersect_batch.",
+        py::arg("boxes"), py::arg("num_threads") = 1);
+    py_cls.def(
+        "overlap_batch",
+        [](const mapped_t &self, const pu::py_coord_array &boxes, std::size_t num_threads) {
+            auto n = pu::num_boxes(boxes);
+            auto ans = pu::csr_ids();
+            {
+                py::gil_scoped_release release;
+                ans = self.overlap_batch(boxes.data(), n, num_threads);
+            }
+            return pu::to_numpy(std::move(ans));
+        },
+        "Queries all objects that overlaps each of the given (N, 4) boxes.  Returns (offsets, "
+        "ids) in the same format as RTree.intersect_batch.",
+        py::arg("boxes"), py::arg("num_threads") = 1);
+}
+
+void bind_rtree(py::module &m) {
+    pyg::declare_iterator<pu::py_rtree::const_iterator>();
+    pyg::declare_iterator<pu::py_rtree::const_query_iterator>();
+
+    auto py_cls = py::class_<pu::py_rtree>(m, "RTree");
+    py_cls.doc() = "An RTree of Python objects.";
+    bind_rtree_class(py_cls);
+
+    auto int_cls = py::class_<pu::int_rtree>(m, "RTreeInt");
+    int_cls.doc() = "An RTree of integers, stored natively.";
+    bind_rtree_class(int_cls);
+
+    auto box_cls = py::class_<pu::box_rtree>(m, "RTreeBox");
+    box_cls.doc() = "An RTree of BBox, stored natively.";
+    bind_rtree_class(box_cls);
+
+    bind_mapped_rtree(m);
 }
@@ -56,10 +56,12 @@ limitations under the License.
 #include <cbag/layout/tech_util.h>
 #include <cbag/layout/via_param_util.h>
 
+#include <pybag/layer_key.h>
 #include <pybag/tech.h>
 
 namespace py = pybind11;
 namespace pyg = pybind11_generics;
+namespace pu = pybag::util;
 
 using c_via_param = cbag::layout::via_param;
 using c_tech = cbag::layout::tech;
@@ -99,6 +101,10 @@ std::optional<cbag::level_t> get_level(const c_tech &tech, const std::string &la
     return tech.get_level(cbag::layout::layer_t_at(tech, layer, purpose));
 }
 
+std::optional<cbag::level_t> get_level_key(const c_tech &tech, pu::py_layer_key key) {
+    return tech.get_level(pu::from_layer_key(key));
+}
+
 pyg::List<py_lp> get_lay_purp_list(const c_tech &tech, cbag::level_t level) {
     pyg::List<py_lp> ans;
     const auto &lp_list = tech.get_lay_purp_list(level);
@@ -117,6 +123,12 @@ std::string get_via_id(const c_tech &tech, cbag::enum_t lev_code, const std::str
                            cbag::layout::layer_t_at(tech, adj_lay, adj_purp));
 }
 
+std::string get_via_id_key(const c_tech &tech, cbag::enum_t lev_code, pu::py_layer_key key,
+                           pu::py_layer_key adj_key) {
+    return tech.get_via_id(static_cast<cbag::direction_1d>(lev_code), pu::from_layer_key(key),
+                           pu::from_layer_key(adj_key));
+}
+
 c_via_param get_via_param(const c_tech &tech, cbag::offset_t w, cbag::offset_t h,
                           const std::string &via_id, cbag::enum_t lev_code,
                           cbag::orientation_2d_t ex_dir, cbag::orientation_2d_t adj_ex_dir,
@@ -139,6 +151,17 @@ cbag::offset_t get_min_le_space(const c_tech &tech, const std::string &layer, cb
                               cbag::space_type::LINE_END, even);
 }
 
+cbag::offset_t get_min_space_key(const c_tech &tech, pu::py_layer_key key, cbag::offset_t width,
+                                 bool same_color, bool even) {
+    return tech.get_min_space(pu::from_layer_key(key), width, cbag::get_space_type(same_color),
+                              even);
+}
+
+cbag::offset_t get_min_le_space_key(const c_tech &tech, pu::py_layer_key key,
+                                    cbag::offset_t width, bool even) {
+    return tech.get_min_space(pu::from_layer_key(key), width, cbag::space_type::LINE_END, even);
+}
+
 } // namespace tech
 } // namespace pybag
 
@@ -187,16 +210,31 @@ void bind_tech(py::module &m) {
     py_cls.def_property_readonly("make_pin", &c_tech::get_make_pin, "True to make pin objects.");
     py_cls.def_property_readonly("bot_layer", &c_tech::get_bot_level, "The bottom layer ID.");
 
+    py_cls.def("layer_key",
+               [](const c_tech &t, const std::string &layer, const std::string &purpose) {
+                   return pu::to_layer_key(cbag::layout::layer_t_at(t, layer, purpose));
+               },
+               "Returns an integer handle for the given layer/purpose pair.  Methods that take a "
+               "layer and purpose also accept this handle, which skips the name lookup.",
+               py::arg("layer"), py::arg("purpose") = "");
     py_cls.def("get_layer_id", &pybag::tech::get_level, "Returns the layer level ID.",
                py::arg("layer"), py::arg("purpose") = "");
+    py_cls.def("get_layer_id", &pybag::tech::get_level_key, "Returns the layer level ID.",
+               py::arg("layer_key"));
     py_cls.def("get_lay_purp_list", &pybag::tech::get_lay_purp_list,
                "Returns the layer/purpose pairs on the given layer level.", py::arg("layer_id"));
     py_cls.def("get_min_space", &pybag::tech::get_min_space,
                "Returns the minimum required spacing.", py::arg("layer"), py::arg("width"),
                py::arg("purpose") = "", py::arg("same_color") = false, py::arg("even") = false);
+    py_cls.def("get_min_space", &pybag::tech::get_min_space_key,
+               "Returns the minimum required spacing.", py::arg("layer_key"), py::arg("width"),
+               py::arg("same_color") = false, py::arg("even") = false);
     py_cls.def("get_min_line_end_space", &pybag::tech::get_min_le_space,
                "Returns the minimum required spacing.", py::arg("layer"), py::arg("width"),
                py::arg("purpose") = "", py::arg("even") = false);
+    py_cls.def("get_min_line_end_space", &pybag::tech::get_min_le_space_key,
+               "Returns the minimum required spacing.", py::arg("layer_key"), py::arg("width"),
+               py::arg("even") = false);
     py_cls.def("get_next_length",
                [](const c_tech &t, const std::string &layer, const std::string &purpose,
                   cbag::orientation_2d_t tr_dir_code, cbag::offset_t width, cbag::offset_t cur_len,
@@ -222,6 +260,8 @@ void bind_tech(py::module &m) {
     py_cls.def("get_via_id", &pybag::tech::get_via_id, "Returns the via ID name.",
                py::arg("lev_code"), py::arg("lay"), py::arg("purp"), py::arg("adj_lay"),
                py::arg("adj_purp"));
+    py_cls.def("get_via_id", &pybag::tech::get_via_id_key, "Returns the via ID name.",
+               py::arg("lev_code"), py::arg("layer_key"), py::arg("adj_layer_key"));
     py_cls.def("get_via_param", &pybag::tech::get_via_param,
                "Calculates the via parameters from the given specs.", py::arg("w"), py::arg("h"),
                py::arg("via_id"), py::arg("lev_code"), py::arg("ex_dir"), py::arg("adj_ex_dir"),